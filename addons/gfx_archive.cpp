@@ -0,0 +1,402 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_archive.h"
+#include "gfx_hash.h"
+
+#include <bx/readerwriter.h>
+#include <stdlib.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    const uint32_t kArchiveMagic   = BX_MAKEFOURCC('G', 'F', 'X', 'A');
+    const uint32_t kArchiveVersion = 1;
+    const size_t   kMaxNameLength  = 511;
+
+    struct ArchiveHeader
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t entryCount;
+      uint32_t namesSize;
+    };
+
+    // Copies name with '/' separators and without a leading "./". Returns its length, or 0 if it
+    // is empty or too long.
+    size_t normaliseName(const char* name, char normalised[kMaxNameLength + 1])
+    {
+      while (name[0] == '.' && (name[1] == '/' || name[1] == '\\'))
+        name += 2;
+
+      size_t length = 0;
+      for(;name[length] != '\0';length++)
+      {
+        if (length == kMaxNameLength)
+          return 0;
+        normalised[length] = name[length] == '\\' ? '/' : name[length];
+      }
+
+      normalised[length] = '\0';
+      return length;
+    }
+
+    struct SortedEntry
+    {
+      uint64_t    hash;
+      const char* name;
+      uint32_t    index;
+    };
+
+    // by hash, then by name, so the same files always make the same archive.
+    int compareSortedEntries(const void* _a, const void* _b)
+    {
+      const SortedEntry* a = (const SortedEntry*) _a;
+      const SortedEntry* b = (const SortedEntry*) _b;
+
+      if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+
+      return strcmp(a->name, b->name);
+    }
+  }
+
+  struct Archive::Entry
+  {
+    uint64_t hash;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+
+  namespace
+  {
+    Archive* _mounted[kMaxMountedArchives];
+    uint32_t _mountedCount;
+  }
+
+  Archive::Archive()
+    : entries(nullptr),
+      names(nullptr),
+      entryCount(0)
+  {
+  }
+
+  Archive::~Archive()
+  {
+    close();
+  }
+
+  bool Archive::open(const char* path)
+  {
+    close();
+
+    if (file.open(path) != 0)
+      return false;
+
+    const uint8_t* base = file.getData();
+    size_t size = file.getSize();
+
+    ArchiveHeader header;
+    if (size < sizeof(header))
+    {
+      close();
+      return false;
+    }
+
+    memcpy(&header, base, sizeof(header));
+
+    uint64_t tocSize = uint64_t(header.entryCount) * sizeof(Entry);
+    if (header.magic != kArchiveMagic || header.version != kArchiveVersion || sizeof(header) + tocSize + header.namesSize > size)
+    {
+      close();
+      return false;
+    }
+
+    const Entry* toc = (const Entry*) (base + sizeof(header));
+    const char* tocNames = (const char*) (base + sizeof(header) + tocSize);
+
+    // check everything once here, so that find can trust it.
+    for(uint32_t i=0;i < header.entryCount;i++)
+    {
+      const Entry& entry = toc[i];
+
+      bool valid = uint64_t(entry.nameOffset) + entry.nameLength < header.namesSize
+        && tocNames[entry.nameOffset + entry.nameLength] == '\0'
+        && entry.offset <= size && entry.size <= size - entry.offset
+        && (i == 0 || toc[i - 1].hash <= entry.hash);
+
+      if (valid == false)
+      {
+        close();
+        return false;
+      }
+    }
+
+    entries = toc;
+    names = tocNames;
+    entryCount = header.entryCount;
+    return true;
+  }
+
+  void Archive::close()
+  {
+    file.close();
+    entries = nullptr;
+    names = nullptr;
+    entryCount = 0;
+  }
+
+  bool Archive::find(const char* name, const uint8_t*& data, size_t& size) const
+  {
+    char normalised[kMaxNameLength + 1];
+    size_t length = normaliseName(name, normalised);
+    if (length == 0 || entryCount == 0)
+      return false;
+
+    uint64_t hash = hashBytes(kHashSeed, normalised, length);
+
+    // the first entry with the hash, then any others that share it.
+    uint32_t first = 0;
+    uint32_t count = entryCount;
+    while (count > 0)
+    {
+      uint32_t step = count / 2;
+      if (entries[first + step].hash < hash)
+      {
+        first += step + 1;
+        count -= step + 1;
+      }
+      else
+      {
+        count = step;
+      }
+    }
+
+    for(uint32_t i=first;i < entryCount && entries[i].hash == hash;i++)
+    {
+      const Entry& entry = entries[i];
+      if (entry.nameLength == length && memcmp(names + entry.nameOffset, normalised, length) == 0)
+      {
+        data = file.getData() + entry.offset;
+        size = size_t(entry.size);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  const char* Archive::getEntryName(uint32_t index) const
+  {
+    return index < entryCount ? names + entries[index].nameOffset : nullptr;
+  }
+
+  size_t Archive::getEntrySize(uint32_t index) const
+  {
+    return index < entryCount ? size_t(entries[index].size) : 0;
+  }
+
+  bool mountArchive(Archive* archive)
+  {
+    if (_mountedCount == kMaxMountedArchives)
+      return false;
+
+    _mounted[_mountedCount++] = archive;
+    return true;
+  }
+
+  void unmountArchive(Archive* archive)
+  {
+    for(uint32_t i=0;i < _mountedCount;i++)
+    {
+      if (_mounted[i] == archive)
+      {
+        memmove(&_mounted[i], &_mounted[i + 1], sizeof(Archive*) * (_mountedCount - i - 1));
+        _mountedCount--;
+        return;
+      }
+    }
+  }
+
+  bool findInMountedArchives(const char* name, const uint8_t*& data, size_t& size)
+  {
+    for(uint32_t i=_mountedCount;i > 0;i--)
+    {
+      if (_mounted[i - 1]->find(name, data, size))
+        return true;
+    }
+
+    return false;
+  }
+
+#endif
+
+  bool ArchiveBuilder::add(const char* name, const void* _data, size_t size)
+  {
+    char normalised[kMaxNameLength + 1];
+    size_t length = normaliseName(name, normalised);
+    if (length == 0)
+      return false;
+
+    uint64_t hash = hashBytes(kHashSeed, normalised, length);
+
+    for(size_t i=0;i < entries.size();i++)
+    {
+      if (entries[i].hash == hash && entries[i].nameLength == length && memcmp(&names[entries[i].nameOffset], normalised, length) == 0)
+        return false;
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    entry.nameOffset = uint32_t(names.size());
+    entry.nameLength = uint32_t(length);
+    entry.dataOffset = data.size();
+    entry.size = size;
+    entries.push_back(entry);
+
+    names.insert(names.end(), normalised, normalised + length + 1);
+
+    // room for the 0 after it, then up to the next aligned offset.
+    size_t padded = (size + 1 + kArchiveAlignment - 1) & ~size_t(kArchiveAlignment - 1);
+    data.resize(data.size() + padded, 0);
+    if (size > 0)
+      memcpy(&data[entry.dataOffset], _data, size);
+
+    return true;
+  }
+
+  bool ArchiveBuilder::addFile(const char* path, const char* name, bx::FileReaderI* reader)
+  {
+    bool ownReader = false;
+    bool ok = false;
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = new bx::CrtFileReader();
+      ownReader = true;
+    }
+#endif
+
+    if (bx::open(reader, path) == 0)
+    {
+      GFX_VECTOR<uint8_t> contents;
+      contents.resize(size_t(bx::getSize(reader)));
+
+      int32_t size = int32_t(contents.size());
+      ok = size == 0 || bx::read(reader, &contents[0], size) == size;
+      bx::close(reader);
+
+      if (ok)
+        ok = add(name != nullptr ? name : path, size > 0 ? &contents[0] : nullptr, contents.size());
+    }
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownReader)
+    {
+      delete reader;
+    }
+#endif
+
+    return ok;
+  }
+
+  bool ArchiveBuilder::save(const char* path, bx::FileWriterI* writer) const
+  {
+    bool ownWriter = false;
+    bool ok = false;
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (writer == nullptr)
+    {
+      writer = new bx::CrtFileWriter();
+      ownWriter = true;
+    }
+#endif
+
+    GFX_VECTOR<SortedEntry> order;
+    order.resize(entries.size());
+    for(size_t i=0;i < order.size();i++)
+    {
+      order[i].hash = entries[i].hash;
+      order[i].name = &names[entries[i].nameOffset];
+      order[i].index = uint32_t(i);
+    }
+
+    if (order.empty() == false)
+      qsort(&order[0], order.size(), sizeof(SortedEntry), compareSortedEntries);
+
+    ArchiveHeader header;
+    header.magic = kArchiveMagic;
+    header.version = kArchiveVersion;
+    header.entryCount = uint32_t(entries.size());
+    header.namesSize = uint32_t(names.size());
+
+    size_t tocEnd = sizeof(header) + entries.size() * sizeof(Archive::Entry) + names.size();
+    size_t dataStart = (tocEnd + kArchiveAlignment - 1) & ~size_t(kArchiveAlignment - 1);
+
+    if (bx::open(writer, path) == 0)
+    {
+      bx::write(writer, header);
+
+      for(size_t i=0;i < order.size();i++)
+      {
+        const Entry& entry = entries[order[i].index];
+
+        Archive::Entry out;
+        out.hash = entry.hash;
+        out.nameOffset = entry.nameOffset;
+        out.nameLength = entry.nameLength;
+        out.offset = dataStart + entry.dataOffset;
+        out.size = entry.size;
+        bx::write(writer, out);
+      }
+
+      if (names.empty() == false)
+        bx::write(writer, &names[0], int32_t(names.size()));
+
+      static const uint8_t padding[kArchiveAlignment] = { 0 };
+      bx::write(writer, padding, int32_t(dataStart - tocEnd));
+
+      ok = data.empty() || bx::write(writer, &data[0], int32_t(data.size())) == int32_t(data.size());
+
+      bx::close(writer);
+    }
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownWriter)
+    {
+      delete writer;
+    }
+#endif
+
+    return ok;
+  }
+
+}
@@ -0,0 +1,135 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_ARCHIVE_H
+#define GFX_ARCHIVE_H
+
+#include "gfx.h"
+#include "gfx_mapped_file.h"
+
+namespace GFX_NS
+{
+
+  // Archive; many files packed into one, to be mapped once and read in place.
+  //  'GFXA' uint32, version uint32, entry count uint32, names size uint32
+  //  per entry, sorted by hash; hash uint64, name offset uint32, name length uint32, offset uint64, size uint64
+  //  names, each followed by a 0
+  //  entry data, each starting at a multiple of kArchiveAlignment and followed by at least one 0
+  //
+  // Entries are named by the path they are loaded with, using '/', e.g. "shaders/dx11/vs_mesh.bin",
+  // so one archive can hold the shaders for every renderer type. The hash is FNV-1a of the name.
+  static const uint32_t kArchiveAlignment = 16;
+
+  // A mapped archive file.
+  class Archive
+  {
+  public:
+
+    Archive();
+    ~Archive();
+
+    // Maps the archive and checks its table of contents. Returns false if it can't be opened or
+    // isn't an archive.
+    bool open(const char* path);
+
+    //
+    void close();
+
+    // Finds an entry by name, with a binary search on its hash. data points into the mapping, and
+    // is valid until the archive is closed.
+    bool find(const char* name, const uint8_t*& data, size_t& size) const;
+
+    //
+    uint32_t getEntryCount() const { return entryCount; }
+
+    // Entries are in hash order.
+    const char* getEntryName(uint32_t index) const;
+
+    //
+    size_t getEntrySize(uint32_t index) const;
+
+  private:
+
+    friend class ArchiveBuilder;
+
+    Archive(const Archive&);
+    Archive& operator=(const Archive&);
+
+    struct Entry;
+
+    MappedFileReader file;
+    const Entry*     entries;
+    const char*      names;
+    uint32_t         entryCount;
+  };
+
+  // Mounted archives are searched by MappedFileReader::open, most recently mounted first, before
+  // it goes to the file system; so the loaders, when they aren't given a reader, read from them
+  // without knowing. Mount and unmount only while nothing is loading.
+  static const uint32_t kMaxMountedArchives = 16;
+
+  // Returns false if kMaxMountedArchives are already mounted.
+  bool mountArchive(Archive* archive);
+
+  //
+  void unmountArchive(Archive* archive);
+
+  //
+  bool findInMountedArchives(const char* name, const uint8_t*& data, size_t& size);
+
+  // Collects files in memory and writes them out as an archive.
+  class ArchiveBuilder
+  {
+  public:
+
+    // Copies the data. Returns false if there is already an entry with the name.
+    bool add(const char* name, const void* data, size_t size);
+
+    // Reads the file at path and adds it, named path unless a name is given.
+    bool addFile(const char* path, const char* name = nullptr, bx::FileReaderI* _reader = nullptr);
+
+    //
+    bool save(const char* path, bx::FileWriterI* _writer = nullptr) const;
+
+    //
+    size_t getEntryCount() const { return entries.size(); }
+
+  private:
+
+    struct Entry
+    {
+      uint64_t hash;
+      uint32_t nameOffset;
+      uint32_t nameLength;
+      size_t   dataOffset;
+      size_t   size;
+    };
+
+    GFX_VECTOR<Entry>   entries;
+    GFX_VECTOR<char>    names;
+    GFX_VECTOR<uint8_t> data;
+  };
+
+}
+
+#endif
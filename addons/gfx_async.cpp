@@ -0,0 +1,449 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_async.h"
+#include "gfx_mapped_file.h"
+#include "gfx_mesh.h"
+#include "gfx_program.h"
+#include "gfx_task.h"
+
+#include <bx/allocator.h>
+#include <bx/mutex.h>
+#include <bx/readerwriter.h>
+#include <utility>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    enum LoadKind
+    {
+      kMeshLoad,
+      kProgramLoad
+    };
+
+    enum LoadStage
+    {
+      kReading,   // on a worker
+      kRead,      // waiting for updateAsync
+      kDone
+    };
+
+    struct AsyncLoad
+    {
+      LoadKind            kind;
+      LoadStage           stage;
+      bool                failed;
+      bool                released;
+
+      char                names[2][512];   // a program's shader names, as loadProgram takes them
+      char                paths[2][512];
+
+      MeshData            meshData;
+      uint8_t*            shaderData[2];
+      uint32_t            shaderSize[2];
+
+      Mesh                mesh;
+      bgfx::ProgramHandle program;
+      uint32_t            size;     // given to bgfx
+
+      AsyncMeshFn         meshCallback;
+      AsyncProgramFn      programCallback;
+      void*               userData;
+    };
+
+    struct AsyncLoader
+    {
+      AsyncLoader()
+        : finishedHead(0),
+          budget(kDefaultAsyncUploadBudget),
+          inFlight(0)
+      {
+        memset(loads, 0, sizeof(loads));
+        memset(generations, 0, sizeof(generations));
+      }
+
+      bx::Mutex            mutex;
+      bx::CrtAllocator     allocator;
+      AsyncLoad*           loads[kMaxAsyncLoads];
+      uint16_t             generations[kMaxAsyncLoads];
+      GFX_VECTOR<uint16_t> finished;   // read, in the order they finished
+      size_t               finishedHead;
+      uint32_t             budget;
+      uint32_t             inFlight;
+    };
+
+    AsyncLoader sLoader;
+
+    const AsyncHandle kInvalidAsyncHandle = { UINT16_MAX, 0 };
+
+    // call with the mutex held.
+    AsyncLoad* getLoad(AsyncHandle handle)
+    {
+      if (handle.idx >= kMaxAsyncLoads || sLoader.generations[handle.idx] != handle.generation)
+        return nullptr;
+
+      return sLoader.loads[handle.idx];
+    }
+
+    // call with the mutex held.
+    AsyncState getState(const AsyncLoad* load)
+    {
+      if (load == nullptr || load->released)
+        return AsyncState::Invalid;
+
+      if (load->stage != kDone)
+        return AsyncState::Loading;
+
+      return load->failed ? AsyncState::Failed : AsyncState::Ready;
+    }
+
+    uint8_t* readShader(const char* path, uint32_t& size)
+    {
+      uint8_t* data = nullptr;
+      size = 0;
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+      MappedFileReader reader;
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+      bx::CrtFileReader reader;
+#endif
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+      if (bx::open(&reader, path) == 0)
+      {
+        size = (uint32_t) bx::getSize(&reader);
+        data = (uint8_t*) BX_ALLOC(&sLoader.allocator, size > 0 ? size : 1);
+        bx::read(&reader, data, size);
+        bx::close(&reader);
+      }
+#endif
+
+      return data;
+    }
+
+    void readAsync(void* userData)
+    {
+      uint16_t idx = uint16_t(uintptr_t(userData));
+      AsyncLoad* load;
+      {
+        bx::MutexScope lock(sLoader.mutex);
+        load = sLoader.loads[idx];
+      }
+
+      switch(load->kind)
+      {
+        case kMeshLoad:
+        {
+          loadTextMesh(load->paths[0], load->meshData);
+          load->failed = load->meshData.vertexData.size == 0;
+        }
+        break;
+        case kProgramLoad:
+        {
+          for(size_t i=0;i < 2;i++)
+            load->shaderData[i] = readShader(load->paths[i], load->shaderSize[i]);
+          load->failed = load->shaderData[0] == nullptr || load->shaderData[1] == nullptr;
+        }
+        break;
+      }
+
+      bx::MutexScope lock(sLoader.mutex);
+      load->stage = kRead;
+      sLoader.finished.push_back(idx);
+    }
+
+    // the callbacks are set here, under the lock, as a worker may read the load straight away.
+    // A mesh load's name is its path; a program load's are its shader names, and the paths are
+    // worked out from them on this thread.
+    AsyncHandle startLoad(LoadKind kind, const char* name0, const char* name1, AsyncMeshFn meshCallback, AsyncProgramFn programCallback, void* userData)
+    {
+      uint16_t idx = UINT16_MAX;
+      uint16_t generation = 0;
+      {
+        bx::MutexScope lock(sLoader.mutex);
+
+        for(uint16_t i=0;i < kMaxAsyncLoads;i++)
+        {
+          if (sLoader.loads[i] == nullptr)
+          {
+            idx = i;
+            break;
+          }
+        }
+
+        if (idx == UINT16_MAX)
+          return kInvalidAsyncHandle;
+
+        AsyncLoad* load = BX_NEW(&sLoader.allocator, AsyncLoad);
+        load->kind = kind;
+        load->stage = kReading;
+        load->failed = false;
+        load->released = false;
+        // workers fill it, so it can't use the default allocator, which needn't be thread safe.
+        load->meshData = MeshData(&sLoader.allocator);
+        strncpy(load->names[0], name0, sizeof(load->names[0]) - 1);
+        load->names[0][sizeof(load->names[0]) - 1] = '\0';
+        strncpy(load->names[1], name1, sizeof(load->names[1]) - 1);
+        load->names[1][sizeof(load->names[1]) - 1] = '\0';
+
+        if (kind == kProgramLoad)
+        {
+          getShaderPath(load->paths[0], load->names[0]);
+          getShaderPath(load->paths[1], load->names[1]);
+        }
+        else
+        {
+          strcpy(load->paths[0], load->names[0]);
+          load->paths[1][0] = '\0';
+        }
+        load->shaderData[0] = load->shaderData[1] = nullptr;
+        load->shaderSize[0] = load->shaderSize[1] = 0;
+        load->mesh.vertexBuffer.idx = bgfx::invalidHandle;
+        load->mesh.indexBuffer.idx = bgfx::invalidHandle;
+        load->program.idx = bgfx::invalidHandle;
+        load->size = 0;
+        load->meshCallback = meshCallback;
+        load->programCallback = programCallback;
+        load->userData = userData;
+
+        sLoader.loads[idx] = load;
+        sLoader.inFlight++;
+        generation = sLoader.generations[idx];
+      }
+
+      AsyncHandle handle = { idx, generation };
+      return handle;
+    }
+
+    // Creates the bgfx resources of a read load, returns the number of bytes handed to bgfx.
+    uint32_t upload(AsyncLoad& load)
+    {
+      uint32_t size = 0;
+
+      switch(load.kind)
+      {
+        case kMeshLoad:
+        {
+          if (load.failed == false)
+          {
+            size = load.meshData.vertexData.size + load.meshData.indexData.size;
+            load.mesh = createMesh(std::move(load.meshData));
+          }
+
+          load.meshData = MeshData(&sLoader.allocator);
+        }
+        break;
+        case kProgramLoad:
+        {
+          if (load.failed == false)
+          {
+            size = load.shaderSize[0] + load.shaderSize[1];
+
+            // through loadProgram's cache, so a program or shader that is already loaded is shared.
+            PreloadedShaderReader reader(load.paths, load.shaderData, load.shaderSize);
+            load.program = loadProgram(load.names[0], load.names[1], &reader);
+            load.failed = load.program.idx == bgfx::invalidHandle;
+          }
+
+          for(size_t i=0;i < 2;i++)
+            BX_FREE(&sLoader.allocator, load.shaderData[i]);
+        }
+        break;
+      }
+
+      return size;
+    }
+
+    void destroyResources(AsyncLoad& load)
+    {
+      if (load.mesh.vertexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyVertexBuffer(load.mesh.vertexBuffer);
+      if (load.mesh.indexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyIndexBuffer(load.mesh.indexBuffer);
+      if (load.program.idx != bgfx::invalidHandle)
+        releaseProgram(load.program);
+    }
+
+    // call with the mutex held.
+    void freeLoad(uint16_t idx)
+    {
+      BX_DELETE(&sLoader.allocator, sLoader.loads[idx]);
+      sLoader.loads[idx] = nullptr;
+      sLoader.generations[idx]++;
+    }
+  }
+
+  AsyncHandle loadTextMeshAsync(const char* path, AsyncMeshFn callback, void* userData)
+  {
+    AsyncHandle handle = startLoad(kMeshLoad, path, "", callback, nullptr, userData);
+
+    if (handle.idx != UINT16_MAX)
+    {
+      runTask(readAsync, (void*) uintptr_t(handle.idx));
+    }
+
+    return handle;
+  }
+
+  AsyncHandle loadProgramAsync(const char* vertexShaderName, const char* fragmentShaderName, AsyncProgramFn callback, void* userData)
+  {
+    AsyncHandle handle = startLoad(kProgramLoad, vertexShaderName, fragmentShaderName, nullptr, callback, userData);
+
+    if (handle.idx != UINT16_MAX)
+    {
+      runTask(readAsync, (void*) uintptr_t(handle.idx));
+    }
+
+    return handle;
+  }
+
+  AsyncState getAsyncState(AsyncHandle handle)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+    return getState(getLoad(handle));
+  }
+
+  bool getAsyncMesh(AsyncHandle handle, Mesh& mesh)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+
+    AsyncLoad* load = getLoad(handle);
+    if (getState(load) != AsyncState::Ready || load->kind != kMeshLoad)
+      return false;
+
+    mesh = load->mesh;
+    return true;
+  }
+
+  bool getAsyncProgram(AsyncHandle handle, bgfx::ProgramHandle& program)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+
+    AsyncLoad* load = getLoad(handle);
+    if (getState(load) != AsyncState::Ready || load->kind != kProgramLoad)
+      return false;
+
+    program = load->program;
+    return true;
+  }
+
+  uint32_t getAsyncSize(AsyncHandle handle)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+
+    AsyncLoad* load = getLoad(handle);
+    return getState(load) == AsyncState::Ready ? load->size : 0;
+  }
+
+  void releaseAsync(AsyncHandle handle)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+
+    AsyncLoad* load = getLoad(handle);
+    if (load == nullptr || load->released)
+      return;
+
+    // still loading; updateAsync frees it once it's been read.
+    if (load->stage != kDone)
+    {
+      load->released = true;
+      return;
+    }
+
+    freeLoad(handle.idx);
+  }
+
+  void setAsyncUploadBudget(uint32_t bytes)
+  {
+    bx::MutexScope lock(sLoader.mutex);
+    sLoader.budget = bytes;
+  }
+
+  uint32_t updateAsync()
+  {
+    uint32_t spent = 0;
+
+    for(;;)
+    {
+      uint16_t idx;
+      AsyncLoad* load;
+      uint32_t budget;
+      {
+        bx::MutexScope lock(sLoader.mutex);
+
+        if (sLoader.finishedHead == sLoader.finished.size())
+        {
+          sLoader.finished.clear();
+          sLoader.finishedHead = 0;
+          return sLoader.inFlight;
+        }
+
+        budget = sLoader.budget;
+        if (spent > 0 && spent >= budget)
+          return sLoader.inFlight;
+
+        idx = sLoader.finished[sLoader.finishedHead++];
+        load = sLoader.loads[idx];
+      }
+
+      load->size = upload(*load);
+      spent += load->size;
+
+      bool released;
+      uint16_t generation;
+      {
+        bx::MutexScope lock(sLoader.mutex);
+        load->stage = kDone;
+        sLoader.inFlight--;
+        generation = sLoader.generations[idx];
+
+        released = load->released;
+        if (released)
+        {
+          destroyResources(*load);
+          freeLoad(idx);
+        }
+      }
+
+      if (released)
+        continue;
+
+      // copied, as the callback may release the handle.
+      AsyncHandle handle = { idx, generation };
+      Mesh mesh = load->mesh;
+      bgfx::ProgramHandle program = load->program;
+      AsyncMeshFn meshCallback = load->meshCallback;
+      AsyncProgramFn programCallback = load->programCallback;
+      void* userData = load->userData;
+
+      if (meshCallback != nullptr)
+        meshCallback(handle, mesh, userData);
+
+      if (programCallback != nullptr)
+        programCallback(handle, program, userData);
+    }
+  }
+
+}
@@ -0,0 +1,101 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_ASYNC_H
+#define GFX_ASYNC_H
+
+#include "gfx.h"
+
+namespace GFX_NS
+{
+
+  // Loading in the background. Files are read and parsed on the gfx_task workers; the bgfx
+  // buffers, shaders and programs are then created by updateAsync, on the thread that calls it
+  // (the one that submits to bgfx), a few at a time so a frame is never held up for long.
+  //
+  //   AsyncHandle rock = loadTextMeshAsync("rock.txt");
+  //   ...
+  //   updateAsync();                       // once a frame, before frame()
+  //   Mesh mesh;
+  //   if (getAsyncMesh(rock, mesh))
+  //     draw(mesh);
+  //
+  // A handle is kept until releaseAsync; it releases the handle only, not the mesh or program.
+
+  static const uint16_t kMaxAsyncLoads = 1024;
+  static const uint32_t kDefaultAsyncUploadBudget = 4 * 1024 * 1024;
+
+  // The generation is bumped each time a slot is freed, so a handle kept after releaseAsync stays
+  // Invalid even once its slot has been given to another load.
+  struct AsyncHandle
+  {
+    uint16_t idx;
+    uint16_t generation;
+  };
+
+  enum class AsyncState
+  {
+    Invalid,  // not a handle, or released
+    Loading,  // being read, or waiting for updateAsync
+    Ready,
+    Failed
+  };
+
+  // Called by updateAsync once the load is Ready or Failed (with invalid handles).
+  typedef void (*AsyncMeshFn)(AsyncHandle handle, const Mesh& mesh, void* userData);
+  typedef void (*AsyncProgramFn)(AsyncHandle handle, bgfx::ProgramHandle program, void* userData);
+
+  // Returns an invalid handle (idx of UINT16_MAX) if kMaxAsyncLoads are in use.
+  AsyncHandle loadTextMeshAsync(const char* path, AsyncMeshFn callback = nullptr, void* userData = nullptr);
+
+  // The shader paths are worked out here, with loadProgram's rules, so call after bgfx::init.
+  // The program comes from loadProgram, and so is released with releaseProgram.
+  AsyncHandle loadProgramAsync(const char* vertexShaderName, const char* fragmentShaderName, AsyncProgramFn callback = nullptr, void* userData = nullptr);
+
+  //
+  AsyncState getAsyncState(AsyncHandle handle);
+
+  // False until the mesh is Ready.
+  bool getAsyncMesh(AsyncHandle handle, Mesh& mesh);
+
+  // False until the program is Ready.
+  bool getAsyncProgram(AsyncHandle handle, bgfx::ProgramHandle& program);
+
+  // Bytes of vertex and index, or shader, data that were handed to bgfx; 0 until it is Ready.
+  uint32_t getAsyncSize(AsyncHandle handle);
+
+  // Releases the handle. A load still in progress is finished and its resources destroyed.
+  void releaseAsync(AsyncHandle handle);
+
+  // Bytes of vertex, index and shader data that updateAsync may hand to bgfx per call. At least
+  // one load is always done, however big it is.
+  void setAsyncUploadBudget(uint32_t bytes);
+
+  // Creates the bgfx resources of finished loads, up to the budget, and calls their callbacks.
+  // Call once a frame from the thread that submits to bgfx. Returns the number of loads still
+  // in flight.
+  uint32_t updateAsync();
+
+}
+
+#endif
@@ -0,0 +1,344 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_geometry_arena.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  GeometryArena::GeometryArena(const bgfx::VertexDecl& _decl, GeometryArenaType _type, uint32_t _pageVertices, uint32_t _pageIndices)
+    : decl(_decl),
+      type(_type),
+      pageVertices(_pageVertices),
+      pageIndices(_pageIndices),
+      built(false)
+  {
+  }
+
+  GeometryArena::~GeometryArena()
+  {
+    for(size_t i=0;i < pages.size();i++)
+    {
+      Page& page = pages[i];
+
+      if (page.vertexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyVertexBuffer(page.vertexBuffer);
+      if (page.indexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyIndexBuffer(page.indexBuffer);
+      if (page.dynamicVertexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyDynamicVertexBuffer(page.dynamicVertexBuffer);
+      if (page.dynamicIndexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyDynamicIndexBuffer(page.dynamicIndexBuffer);
+    }
+  }
+
+  bool GeometryArena::takeSpan(GFX_VECTOR<Span>& spans, uint32_t count, uint32_t& first)
+  {
+    for(size_t i=0;i < spans.size();i++)
+    {
+      if (spans[i].count < count)
+        continue;
+
+      first = spans[i].first;
+      spans[i].first += count;
+      spans[i].count -= count;
+
+      if (spans[i].count == 0)
+        spans.erase(spans.begin() + i);
+
+      return true;
+    }
+
+    return false;
+  }
+
+  void GeometryArena::freeSpan(GFX_VECTOR<Span>& spans, uint32_t first, uint32_t count)
+  {
+    if (count == 0)
+      return;
+
+    size_t i = 0;
+    while (i < spans.size() && spans[i].first < first)
+      i++;
+
+    bool joinsBefore = i > 0 && spans[i - 1].first + spans[i - 1].count == first;
+    bool joinsAfter = i < spans.size() && first + count == spans[i].first;
+
+    if (joinsBefore && joinsAfter)
+    {
+      spans[i - 1].count += count + spans[i].count;
+      spans.erase(spans.begin() + i);
+    }
+    else if (joinsBefore)
+    {
+      spans[i - 1].count += count;
+    }
+    else if (joinsAfter)
+    {
+      spans[i].first = first;
+      spans[i].count += count;
+    }
+    else
+    {
+      Span span = { first, count };
+      spans.insert(spans.begin() + i, span);
+    }
+  }
+
+  void GeometryArena::freePending()
+  {
+    uint32_t frameCount = getFrameCount();
+
+    size_t kept = 0;
+    for(size_t i=0;i < pendingFrees.size();i++)
+    {
+      const PendingFree& pending = pendingFrees[i];
+
+      if (pending.frame > frameCount)
+      {
+        pendingFrees[kept++] = pending;
+        continue;
+      }
+
+      Page& page = pages[pending.mesh.page];
+      freeSpan(page.freeVertices, pending.mesh.firstVertex, pending.mesh.vertexCount);
+      freeSpan(page.freeIndices, pending.mesh.firstIndex, pending.mesh.indexCount);
+      page.vertexCount -= pending.mesh.vertexCount;
+      page.indexCount -= pending.mesh.indexCount;
+    }
+
+    pendingFrees.resize(kept);
+  }
+
+  bool GeometryArena::allocate(ArenaMesh& mesh)
+  {
+    for(uint32_t i=0;i < pages.size();i++)
+    {
+      Page& page = pages[i];
+
+      if (type == GeometryArenaType::Static)
+      {
+        if (page.vertexCount + mesh.vertexCount > page.vertexCapacity || page.indexCount + mesh.indexCount > page.indexCapacity)
+          continue;
+
+        mesh.firstVertex = page.vertexCount;
+        mesh.firstIndex = page.indexCount;
+      }
+      else
+      {
+        uint32_t firstVertex = 0, firstIndex = 0;
+        if (takeSpan(page.freeVertices, mesh.vertexCount, firstVertex) == false)
+          continue;
+
+        if (mesh.indexCount > 0 && takeSpan(page.freeIndices, mesh.indexCount, firstIndex) == false)
+        {
+          freeSpan(page.freeVertices, firstVertex, mesh.vertexCount);
+          continue;
+        }
+
+        mesh.firstVertex = firstVertex;
+        mesh.firstIndex = firstIndex;
+      }
+
+      mesh.page = i;
+      page.vertexCount += mesh.vertexCount;
+      page.indexCount += mesh.indexCount;
+      return true;
+    }
+
+    // a new page, big enough for the mesh.
+    pages.push_back(Page());
+    Page& page = pages.back();
+
+    page.vertexCapacity = mesh.vertexCount > pageVertices ? mesh.vertexCount : pageVertices;
+    page.indexCapacity = mesh.indexCount > pageIndices ? mesh.indexCount : pageIndices;
+    page.vertexCount = 0;
+    page.indexCount = 0;
+    page.vertexBuffer.idx = bgfx::invalidHandle;
+    page.indexBuffer.idx = bgfx::invalidHandle;
+    page.dynamicVertexBuffer.idx = bgfx::invalidHandle;
+    page.dynamicIndexBuffer.idx = bgfx::invalidHandle;
+
+    if (type == GeometryArenaType::Dynamic)
+    {
+      page.dynamicVertexBuffer = bgfx::createDynamicVertexBuffer(page.vertexCapacity, decl);
+      page.dynamicIndexBuffer = bgfx::createDynamicIndexBuffer(page.indexCapacity);
+
+      if (page.dynamicVertexBuffer.idx == bgfx::invalidHandle || page.dynamicIndexBuffer.idx == bgfx::invalidHandle)
+      {
+        if (page.dynamicVertexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyDynamicVertexBuffer(page.dynamicVertexBuffer);
+        if (page.dynamicIndexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyDynamicIndexBuffer(page.dynamicIndexBuffer);
+        pages.pop_back();
+        return false;
+      }
+
+      Span vertices = { 0, page.vertexCapacity };
+      Span indices = { 0, page.indexCapacity };
+      page.freeVertices.push_back(vertices);
+      page.freeIndices.push_back(indices);
+    }
+
+    return allocate(mesh);
+  }
+
+  uint32_t GeometryArena::add(const MeshData& meshData)
+  {
+    if (built || meshData.decl.m_hash != decl.m_hash)
+      return kInvalidArenaMesh;
+
+    ArenaMesh mesh;
+    mesh.vertexCount = uint32_t(getVertexCount(meshData));
+    mesh.indexCount = uint32_t(getIndexCount(meshData));
+    mesh.used = true;
+
+    if (type == GeometryArenaType::Dynamic)
+      freePending();
+
+    if (mesh.vertexCount == 0 || allocate(mesh) == false)
+      return kInvalidArenaMesh;
+
+    Page& page = pages[mesh.page];
+    uint32_t vertexSize = mesh.vertexCount * decl.getStride();
+    uint32_t indexSize = mesh.indexCount * sizeof(uint16_t);
+
+    // indices stay relative to the mesh's first vertex, which is the base vertex it's drawn with.
+    if (type == GeometryArenaType::Static)
+    {
+      page.vertexData.resize(page.vertexData.size() + vertexSize);
+      memcpy(&page.vertexData[mesh.firstVertex * decl.getStride()], meshData.vertexData.data, vertexSize);
+
+      if (indexSize > 0)
+      {
+        page.indexData.resize(page.indexData.size() + mesh.indexCount);
+        memcpy(&page.indexData[mesh.firstIndex], meshData.indexData.data, indexSize);
+      }
+    }
+    else
+    {
+      bgfx::updateDynamicVertexBuffer(page.dynamicVertexBuffer, mesh.firstVertex, bgfx::copy(meshData.vertexData.data, vertexSize));
+
+      if (indexSize > 0)
+        bgfx::updateDynamicIndexBuffer(page.dynamicIndexBuffer, mesh.firstIndex, bgfx::copy(meshData.indexData.data, indexSize));
+    }
+
+    if (freeMeshes.empty() == false)
+    {
+      uint32_t idx = freeMeshes.back();
+      freeMeshes.pop_back();
+      meshes[idx] = mesh;
+      return idx;
+    }
+
+    meshes.push_back(mesh);
+    return uint32_t(meshes.size() - 1);
+  }
+
+  void GeometryArena::remove(uint32_t idx)
+  {
+    if (idx >= meshes.size() || meshes[idx].used == false)
+      return;
+
+    ArenaMesh& mesh = meshes[idx];
+    mesh.used = false;
+    freeMeshes.push_back(idx);
+
+    // the room is only written over once the frames that may still draw the mesh are rendered.
+    if (type == GeometryArenaType::Dynamic)
+    {
+      PendingFree pending;
+      pending.mesh = mesh;
+      pending.frame = getFrameCount() + GFX_FRAME_ARENA_COUNT;
+      pendingFrees.push_back(pending);
+    }
+  }
+
+  bool GeometryArena::build()
+  {
+    if (built || type != GeometryArenaType::Static)
+      return false;
+
+    for(size_t i=0;i < pages.size();i++)
+    {
+      Page& page = pages[i];
+
+      page.vertexBuffer = bgfx::createVertexBuffer(bgfx::copy(&page.vertexData[0], uint32_t(page.vertexData.size())), decl);
+
+      if (page.indexData.empty() == false)
+        page.indexBuffer = bgfx::createIndexBuffer(bgfx::copy(&page.indexData[0], uint32_t(page.indexData.size() * sizeof(uint16_t))));
+
+      GFX_VECTOR<uint8_t>().swap(page.vertexData);
+      GFX_VECTOR<uint16_t>().swap(page.indexData);
+    }
+
+    built = true;
+    return true;
+  }
+
+  bool GeometryArena::getMesh(uint32_t idx, MeshRange& out) const
+  {
+    if (idx >= meshes.size() || meshes[idx].used == false)
+      return false;
+
+    if (type == GeometryArenaType::Static && built == false)
+      return false;
+
+    const ArenaMesh& mesh = meshes[idx];
+    const Page& page = pages[mesh.page];
+
+    Mesh none = { BGFX_INVALID_HANDLE, BGFX_INVALID_HANDLE };
+    out = makeMeshRange(none);
+    out.vertexBuffer = page.vertexBuffer;
+    out.dynamicVertexBuffer = page.dynamicVertexBuffer;
+    out.firstVertex = mesh.firstVertex;
+    out.vertexCount = mesh.vertexCount;
+
+    if (mesh.indexCount > 0)
+    {
+      out.indexBuffer = page.indexBuffer;
+      out.dynamicIndexBuffer = page.dynamicIndexBuffer;
+      out.firstIndex = mesh.firstIndex;
+      out.indexCount = mesh.indexCount;
+    }
+
+    return true;
+  }
+
+  void GeometryArena::getStats(GeometryArenaStats& stats) const
+  {
+    memset(&stats, 0, sizeof(stats));
+    stats.pages = uint32_t(pages.size());
+    stats.meshes = uint32_t(meshes.size() - freeMeshes.size());
+
+    for(size_t i=0;i < pages.size();i++)
+    {
+      stats.vertices += pages[i].vertexCount;
+      stats.indices += pages[i].indexCount;
+      stats.vertexCapacity += pages[i].vertexCapacity;
+      stats.indexCapacity += pages[i].indexCapacity;
+    }
+  }
+
+}
@@ -0,0 +1,156 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_GEOMETRY_ARENA_H
+#define GFX_GEOMETRY_ARENA_H
+
+#include "gfx.h"
+
+namespace GFX_NS
+{
+  struct MeshData;
+
+  // Many meshes with the same vertex decl in a few large buffers, rather than a vertex and an
+  // index buffer each. Each MeshRange from the arena is part of a page's buffers, so meshes on
+  // the same page draw without binding new buffers, and use two bgfx handles between them.
+  //
+  // A Static arena copies meshes as they are added and creates its pages' buffers with build;
+  // meshes can't be added after that. A Dynamic arena creates its pages' buffers as it needs
+  // them, copies meshes straight into them, and reuses the room of removed meshes.
+  enum class GeometryArenaType
+  {
+    Static,
+    Dynamic
+  };
+
+  static const uint32_t kInvalidArenaMesh = UINT32_MAX;
+
+  static const uint32_t kDefaultArenaPageVertices = 256 * 1024;
+  static const uint32_t kDefaultArenaPageIndices  = 1024 * 1024;
+
+  struct GeometryArenaStats
+  {
+    uint32_t pages;
+    uint32_t meshes;
+    uint32_t vertices;          // used, by every page
+    uint32_t indices;
+    uint32_t vertexCapacity;    // of every page
+    uint32_t indexCapacity;
+  };
+
+  class GeometryArena
+  {
+  public:
+
+    // Pages hold pageVertices and pageIndices, or a mesh that is bigger on its own page.
+    GeometryArena(const bgfx::VertexDecl& decl, GeometryArenaType type, uint32_t pageVertices = kDefaultArenaPageVertices, uint32_t pageIndices = kDefaultArenaPageIndices);
+
+    // Destroys the buffers, and so every mesh from the arena.
+    ~GeometryArena();
+
+    // Returns the mesh's index in the arena, or kInvalidArenaMesh if its decl isn't the arena's
+    // or a Static arena has been built.
+    uint32_t add(const MeshData& meshData);
+
+    // A Dynamic arena reuses the mesh's room GFX_FRAME_ARENA_COUNT frames later, once nothing
+    // submitted with it can still be rendered; a Static one only forgets the mesh.
+    void remove(uint32_t mesh);
+
+    // Creates a Static arena's buffers and frees the copies of its meshes. Returns false if it
+    // has already been built, or is Dynamic.
+    bool build();
+
+    // False until a Static arena is built, or if mesh was removed.
+    bool getMesh(uint32_t mesh, MeshRange& out) const;
+
+    //
+    void getStats(GeometryArenaStats& stats) const;
+
+  private:
+
+    GeometryArena(const GeometryArena&);
+    GeometryArena& operator=(const GeometryArena&);
+
+    struct Span
+    {
+      uint32_t first;
+      uint32_t count;
+    };
+
+    struct Page
+    {
+      bgfx::VertexBufferHandle        vertexBuffer;
+      bgfx::IndexBufferHandle         indexBuffer;
+      bgfx::DynamicVertexBufferHandle dynamicVertexBuffer;
+      bgfx::DynamicIndexBufferHandle  dynamicIndexBuffer;
+      uint32_t                        vertexCapacity;
+      uint32_t                        indexCapacity;
+      uint32_t                        vertexCount;    // used
+      uint32_t                        indexCount;
+      GFX_VECTOR<Span>                freeVertices;   // Dynamic; sorted, and never next to each other
+      GFX_VECTOR<Span>                freeIndices;
+      GFX_VECTOR<uint8_t>             vertexData;     // Static, until it is built
+      GFX_VECTOR<uint16_t>            indexData;
+    };
+
+    struct ArenaMesh
+    {
+      uint32_t page;
+      uint32_t firstVertex;
+      uint32_t vertexCount;
+      uint32_t firstIndex;
+      uint32_t indexCount;
+      bool     used;
+    };
+
+    // A removed mesh's room, waiting for the frames that may draw it to be rendered.
+    struct PendingFree
+    {
+      ArenaMesh mesh;
+      uint32_t  frame;    // freed once getFrameCount reaches it
+    };
+
+    // first-fit; false if no span holds count.
+    static bool takeSpan(GFX_VECTOR<Span>& spans, uint32_t count, uint32_t& first);
+
+    // merged with the spans either side of it.
+    static void freeSpan(GFX_VECTOR<Span>& spans, uint32_t first, uint32_t count);
+
+    bool allocate(ArenaMesh& mesh);
+
+    void freePending();
+
+    bgfx::VertexDecl        decl;
+    GeometryArenaType       type;
+    uint32_t                pageVertices;
+    uint32_t                pageIndices;
+    bool                    built;
+    GFX_VECTOR<Page>        pages;
+    GFX_VECTOR<ArenaMesh>   meshes;
+    GFX_VECTOR<uint32_t>    freeMeshes;   // removed, for add to reuse
+    GFX_VECTOR<PendingFree> pendingFrees; // Dynamic; removed, but maybe still being drawn
+  };
+
+}
+
+#endif
@@ -0,0 +1,190 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mapped_file.h"
+#include "gfx_archive.h"
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+
+#if BX_PLATFORM_WINDOWS
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace GFX_NS
+{
+
+  MappedFileReader::MappedFileReader()
+    : data(nullptr),
+      size(0),
+      pos(0),
+      isOpen(false),
+      ownsMapping(false)
+  {
+  }
+
+  MappedFileReader::~MappedFileReader()
+  {
+    close();
+  }
+
+  int32_t MappedFileReader::open(const char* _filePath)
+  {
+    close();
+
+    const uint8_t* archived;
+    if (findInMountedArchives(_filePath, archived, size))
+    {
+      data = (uint8_t*) archived;
+      pos = 0;
+      isOpen = true;
+      return 0;
+    }
+
+#if BX_PLATFORM_WINDOWS
+    HANDLE file = CreateFileA(_filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return -1;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) == FALSE)
+    {
+      CloseHandle(file);
+      return -1;
+    }
+
+    size = size_t(fileSize.QuadPart);
+
+    // an empty file can't be mapped, but it can still be opened.
+    if (size > 0)
+    {
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping != NULL)
+      {
+        data = (uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+      }
+    }
+
+    // the view keeps the file open.
+    CloseHandle(file);
+#else
+    int fd = ::open(_filePath, O_RDONLY);
+    if (fd == -1)
+      return -1;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      return -1;
+    }
+
+    size = size_t(info.st_size);
+
+    // an empty file can't be mapped, but it can still be opened.
+    if (size > 0)
+    {
+      void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED)
+      {
+        data = (uint8_t*) mapped;
+        madvise(data, size, MADV_SEQUENTIAL);
+        madvise(data, size, MADV_WILLNEED);
+      }
+    }
+
+    // the mapping keeps the file open.
+    ::close(fd);
+#endif
+
+    if (size > 0 && data == nullptr)
+    {
+      size = 0;
+      return -1;
+    }
+
+    pos = 0;
+    isOpen = true;
+    ownsMapping = data != nullptr;
+    return 0;
+  }
+
+  int32_t MappedFileReader::close()
+  {
+    if (ownsMapping)
+    {
+#if BX_PLATFORM_WINDOWS
+      UnmapViewOfFile(data);
+#else
+      munmap(data, size);
+#endif
+    }
+
+    data = nullptr;
+    size = 0;
+    pos = 0;
+    isOpen = false;
+    ownsMapping = false;
+    return 0;
+  }
+
+  int64_t MappedFileReader::seek(int64_t _offset, bx::Whence::Enum _whence)
+  {
+    int64_t base = 0;
+
+    switch(_whence)
+    {
+      case bx::Whence::Begin:   base = 0; break;
+      case bx::Whence::Current: base = int64_t(pos); break;
+      case bx::Whence::End:     base = int64_t(size); break;
+    }
+
+    int64_t newPos = base + _offset;
+    newPos = newPos < 0 ? 0 : newPos;
+    newPos = newPos > int64_t(size) ? int64_t(size) : newPos;
+
+    pos = size_t(newPos);
+    return newPos;
+  }
+
+  int32_t MappedFileReader::read(void* _data, int32_t _size)
+  {
+    if (isOpen == false || _size <= 0)
+      return 0;
+
+    size_t remaining = size - pos;
+    size_t count = size_t(_size) < remaining ? size_t(_size) : remaining;
+
+    memcpy(_data, data + pos, count);
+    pos += count;
+    return int32_t(count);
+  }
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MAPPED_FILE_H
+#define GFX_MAPPED_FILE_H
+
+#include "gfx.h"
+
+#include <bx/readerwriter.h>
+
+// Whether files can be memory mapped on this platform. The loaders use a MappedFileReader when
+// they aren't given a reader, and a bx::CrtFileReader otherwise.
+#ifndef GFX_CONFIG_MAPPED_FILE_READER
+# define GFX_CONFIG_MAPPED_FILE_READER (BX_PLATFORM_WINDOWS || BX_PLATFORM_LINUX || BX_PLATFORM_OSX || BX_PLATFORM_ANDROID || BX_PLATFORM_IOS)
+#endif
+
+namespace GFX_NS
+{
+
+  // Reads a file that is mapped into memory, read only, rather than through read calls. The
+  // kernel is told the file will be read from front to back, so it reads ahead. Reads are
+  // copies out of the mapping, and the mapping itself is available from getData so that a
+  // loader can parse it in place. The mapping, and so getData, is only valid until close.
+  // Files in a mounted archive (gfx_archive.h) are read from the archive's mapping instead.
+  class MappedFileReader : public bx::FileReaderI
+  {
+  public:
+
+    MappedFileReader();
+    virtual ~MappedFileReader();
+
+    // Returns 0 on success, like bx::CrtFileReader.
+    virtual int32_t open(const char* _filePath);
+    virtual int32_t close();
+    virtual int64_t seek(int64_t _offset = 0, bx::Whence::Enum _whence = bx::Whence::Current);
+    virtual int32_t read(void* _data, int32_t _size);
+
+    // The whole file; nullptr if nothing is open or the file is empty.
+    const uint8_t* getData() const { return data; }
+
+    //
+    size_t getSize() const { return size; }
+
+    //
+    size_t getPos() const { return pos; }
+
+  private:
+
+    MappedFileReader(const MappedFileReader&);
+    MappedFileReader& operator=(const MappedFileReader&);
+
+    uint8_t* data;
+    size_t   size;
+    size_t   pos;
+    bool     isOpen;
+    bool     ownsMapping;   // false when data is in an archive
+  };
+
+}
+
+#endif
@@ -22,8 +22,15 @@
 
 #include "gfx.h"
 #include "gfx_mesh.h"
+#include "gfx_mesh_codec.h"
+#include "gfx_mapped_file.h"
 
 #include <stdio.h>
+#include <math.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include <bx/timer.h>
+#include <bx/uint32_t.h>
 #include <bx/readerwriter.h>
 #include <locale>
 
@@ -61,34 +68,278 @@ namespace GFX_NS
       "float"
     };
 
-    void writeStr(bx::FileWriterI* writer, const char* str)
+    const size_t kTextWriterBlockSize = 256 * 1024;
+
+    // Collects the text in one large block and hands it to the FileWriterI a block at a time,
+    // rather than a virtual write per token.
+    struct TextWriter
+    {
+      TextWriter(bx::FileWriterI* _writer, bx::AllocatorI* _allocator)
+        : allocator(_allocator),
+          writer(_writer),
+          used(0),
+          total(0)
+      {
+        block = (char*) BX_ALLOC(allocator, kTextWriterBlockSize);
+      }
+
+      ~TextWriter()
+      {
+        BX_FREE(allocator, block);
+      }
+
+      // Returns room for at least size (<= 64) characters; call commit with what was used.
+      char* reserve(size_t size)
+      {
+        if (used + size > kTextWriterBlockSize)
+          flush();
+        return block + used;
+      }
+
+      void commit(size_t size)
+      {
+        used += size;
+      }
+
+      void flush()
+      {
+        if (used > 0)
+          writer->write(block, int32_t(used));
+        total += used;
+        used = 0;
+      }
+
+      bx::AllocatorI*  allocator;
+      bx::FileWriterI* writer;
+      char*            block;
+      size_t           used;
+      uint64_t         total;
+    };
+
+    const char kHexDigits[] = "0123456789ABCDEF";
+
+    size_t formatUint(char* dst, uint32_t value)
     {
-      writer->write(str, strlen(str));
+      char digits[10];
+      size_t length = 0;
+      do
+      {
+        digits[length++] = char('0' + value % 10);
+        value /= 10;
+      }
+      while (value != 0);
+
+      for(size_t i=0;i < length;i++)
+        dst[i] = digits[length - 1 - i];
+      return length;
     }
 
-    void writeNewLine(bx::FileWriterI* writer)
+    size_t formatInt(char* dst, int32_t value)
     {
-      writer->write(&kNewLine, 2);
+      if (value < 0)
+      {
+        dst[0] = '-';
+        return 1 + formatUint(dst + 1, 0u - uint32_t(value));
+      }
+      return formatUint(dst, uint32_t(value));
     }
 
-    void writeChar(bx::FileWriterI* writer, const char k)
+    // As "%0*X"; at least minDigits, more if the value needs them.
+    size_t formatHex(char* dst, uint32_t value, size_t minDigits)
     {
-      writer->write(&k, 1);
+      size_t length = 1;
+      while (length < 8 && (value >> (length * 4)) != 0)
+        length++;
+      if (length < minDigits)
+        length = minDigits;
+
+      for(size_t i=0;i < length;i++)
+        dst[i] = kHexDigits[(value >> ((length - 1 - i) * 4)) & 15];
+      return length;
     }
 
-    void writeWhiteSpace(bx::FileWriterI* writer)
+    // 10^-40 to 10^51, which covers scaling any float to six digits.
+    struct PowersOfTen
+    {
+      static const int kMin = -40;
+      static const int kMax = 51;
+
+      PowersOfTen()
+      {
+        double p = 1.0;
+        for(int i=0;i <= kMax;i++, p *= 10.0)
+          positive[i] = p;
+
+        p = 1.0;
+        for(int i=0;i <= -kMin;i++, p *= 10.0)
+          negative[i] = 1.0 / p;
+      }
+
+      double get(int exponent) const
+      {
+        return exponent >= 0 ? positive[exponent] : negative[-exponent];
+      }
+
+      double positive[kMax + 1];
+      double negative[-kMin + 1];
+    };
+
+    const PowersOfTen kPowersOfTen;
+
+    // As "%g"; six significant digits, trailing zeros removed, and an exponent outside of
+    // 1e-4 to 1e6. The float is scaled to six digits in double precision, which is exact enough
+    // to round correctly except when the seventh digit is within a hair of a half. Those, and
+    // inf and nan, are left to snprintf so the output always matches the C library's.
+    size_t formatFloat(char* dst, float value)
     {
-      writer->write(&kWhiteSpaceToken, 1);
+      double a = value;
+      bool negative = signbit(value) != 0;
+      if (negative)
+        a = -a;
+
+      char* start = dst;
+
+      if (a == 0.0)
+      {
+        if (negative)
+          *dst++ = '-';
+        *dst++ = '0';
+        return size_t(dst - start);
+      }
+
+      if (isfinite(a) == false)
+        return snprintf(dst, 64, "%g", value);
+
+      int binaryExponent;
+      frexp(a, &binaryExponent);
+      int exponent = int(floor((binaryExponent - 1) * 0.30102999566398120));
+
+      double scaled = a * kPowersOfTen.get(5 - exponent);
+      while (scaled >= 1000000.0)
+      {
+        exponent++;
+        scaled = a * kPowersOfTen.get(5 - exponent);
+      }
+      while (scaled < 100000.0)
+      {
+        exponent--;
+        scaled = a * kPowersOfTen.get(5 - exponent);
+      }
+
+      double whole = floor(scaled);
+      double fraction = scaled - whole;
+
+      if (fabs(fraction - 0.5) < 1e-6)
+        return snprintf(dst, 64, "%g", value);
+
+      uint32_t n = uint32_t(whole) + (fraction > 0.5 ? 1 : 0);
+      if (n == 1000000)
+      {
+        n = 100000;
+        exponent++;
+      }
+
+      char digits[6];
+      for(size_t i=0;i < 6;i++)
+      {
+        digits[5 - i] = char('0' + n % 10);
+        n /= 10;
+      }
+
+      size_t length = 6;
+      while (length > 1 && digits[length - 1] == '0')
+        length--;
+
+      if (negative)
+        *dst++ = '-';
+
+      if (exponent >= -4 && exponent < 6)
+      {
+        if (exponent >= 0)
+        {
+          for(int i=0;i <= exponent;i++)
+            *dst++ = digits[i];
+
+          if (length > size_t(exponent + 1))
+          {
+            *dst++ = '.';
+            for(size_t i=exponent + 1;i < length;i++)
+              *dst++ = digits[i];
+          }
+        }
+        else
+        {
+          *dst++ = '0';
+          *dst++ = '.';
+          for(int i=0;i < -exponent - 1;i++)
+            *dst++ = '0';
+          for(size_t i=0;i < length;i++)
+            *dst++ = digits[i];
+        }
+      }
+      else
+      {
+        *dst++ = digits[0];
+        if (length > 1)
+        {
+          *dst++ = '.';
+          for(size_t i=1;i < length;i++)
+            *dst++ = digits[i];
+        }
+
+        *dst++ = 'e';
+        *dst++ = exponent < 0 ? '-' : '+';
+        if (exponent < 0)
+          exponent = -exponent;
+        if (exponent < 10)
+          *dst++ = '0';
+        dst += formatUint(dst, uint32_t(exponent));
+      }
+
+      return size_t(dst - start);
+    }
+
+    void writeStr(TextWriter& writer, const char* str, size_t length)
+    {
+      while (length > 0)
+      {
+        size_t chunk = bx::uint32_min(uint32_t(length), 64);
+        memcpy(writer.reserve(chunk), str, chunk);
+        writer.commit(chunk);
+        str += chunk;
+        length -= chunk;
+      }
+    }
+
+    void writeStr(TextWriter& writer, const char* str)
+    {
+      writeStr(writer, str, strlen(str));
+    }
+
+    void writeNewLine(TextWriter& writer)
+    {
+      memcpy(writer.reserve(2), kNewLine, 2);
+      writer.commit(2);
+    }
+
+    void writeChar(TextWriter& writer, const char k)
+    {
+      *writer.reserve(1) = k;
+      writer.commit(1);
+    }
+
+    void writeWhiteSpace(TextWriter& writer)
+    {
+      writeChar(writer, kWhiteSpaceToken);
     }
 
     template<typename T>
-    void writeInt(bx::FileWriterI* writer, const T& value, char buffer[512])
+    void writeInt(TextWriter& writer, const T& value)
     {
-      sprintf(buffer, "%i", value);
-      writer->write(buffer, strlen(buffer));
+      writer.commit(formatInt(writer.reserve(16), int32_t(value)));
     }
 
-    void saveVertexDecl(const bgfx::VertexDecl& decl, bx::FileWriterI* writer, char buffer[512])
+    void saveVertexDecl(const bgfx::VertexDecl& decl, TextWriter& writer)
     {
 
       const char k0 = '=';
@@ -111,7 +362,7 @@ namespace GFX_NS
 
         decl.decode(attribName, num, type, normalised, asInt);
 
-        writeInt(writer, num, buffer); writeWhiteSpace(writer);
+        writeInt(writer, num); writeWhiteSpace(writer);
 
         switch(type)
         {
@@ -147,12 +398,42 @@ namespace GFX_NS
       return str;
     }
 
-    bool readLine(bx::FileReaderI* reader, char line[512])
+    // Where readLine gets its characters from; straight from memory when the file is mapped,
+    // otherwise a byte at a time from the reader.
+    struct LineSource
+    {
+      bx::FileReaderI* reader;
+      const char*      data;
+      const char*      pos;
+      const char*      end;
+    };
+
+    bool readChar(LineSource& source, char& c)
+    {
+      if (source.data == nullptr)
+        return source.reader->read(&c, 1) == 1;
+
+      if (source.pos == source.end)
+        return false;
+
+      c = *source.pos++;
+      return true;
+    }
+
+    void rewind(LineSource& source)
+    {
+      if (source.data == nullptr)
+        source.reader->seek(0, bx::Whence::Begin);
+      else
+        source.pos = source.data;
+    }
+
+    bool readLine(LineSource& source, char line[512])
     {
       char c = 0;
       size_t it = 0;
 
-      while(reader->read(&c, 1) == 1)
+      while(readChar(source, c))
       {
         if (it == 0 && isspace(c))
           continue; // skip whitespace.
@@ -364,26 +645,345 @@ namespace GFX_NS
 
     }
 
+
+    const uint32_t kBinaryMeshMagic   = BX_MAKEFOURCC('G', 'F', 'X', 'M');
+    const uint16_t kBinaryMeshVersion = 1;
+
+    struct BinaryMeshHeader
+    {
+      uint16_t flags;
+      uint32_t vertexCount;
+      uint32_t indexCount;
+      uint32_t vertexBlobSize;
+      uint32_t indexBlobSize;
+      uint32_t vertexSize;      // in bytes, once decoded
+      uint32_t indexSize;
+    };
+
+    bool readBinaryMeshHeader(bx::FileReaderI* reader, bgfx::VertexDecl& decl, BinaryMeshHeader& header)
+    {
+      uint32_t magic = 0;
+      uint16_t version = 0, stride = 0;
+      uint8_t attribCount = 0;
+
+      if (bx::read(reader, magic) != sizeof(magic) || magic != kBinaryMeshMagic)
+        return false;
+
+      if (bx::read(reader, version) != sizeof(version) || version != kBinaryMeshVersion)
+        return false;
+
+      bx::read(reader, header.flags);
+      bx::read(reader, stride);
+
+      if (bx::read(reader, attribCount) != sizeof(attribCount) || attribCount > bgfx::Attrib::Count)
+        return false;
+
+      decl.begin();
+
+      for(size_t i=0;i < attribCount;i++)
+      {
+        uint8_t attrib[4];
+        if (bx::read(reader, attrib, sizeof(attrib)) != sizeof(attrib))
+          return false;
+
+        if (attrib[0] >= bgfx::Attrib::Count || attrib[1] < 1 || attrib[1] > 4 || attrib[2] >= bgfx::AttribType::Count)
+          return false;
+
+        decl.add((bgfx::Attrib::Enum) attrib[0], attrib[1], (bgfx::AttribType::Enum) attrib[2], (attrib[3] & 1) != 0, (attrib[3] & 2) != 0);
+      }
+
+      decl.end();
+
+      if (decl.getStride() != stride)
+        return false;
+
+      bx::read(reader, header.vertexCount);
+      bx::read(reader, header.indexCount);
+      bx::read(reader, header.vertexBlobSize);
+
+      if (bx::read(reader, header.indexBlobSize) != sizeof(header.indexBlobSize))
+        return false;
+
+      // the counts come from the file, so a bad one mustn't wrap the sizes that are allocated.
+      uint64_t vertexSize = uint64_t(header.vertexCount) * stride;
+      uint64_t indexSize = uint64_t(header.indexCount) * sizeof(uint16_t);
+
+      if (vertexSize > UINT32_MAX || indexSize > UINT32_MAX)
+        return false;
+
+      header.vertexSize = uint32_t(vertexSize);
+      header.indexSize = uint32_t(indexSize);
+
+      // an uncompressed blob is the data as it is, and a compressed one can't be bigger than its bound.
+      if ((header.flags & kBinaryMeshCompressVertices) != 0 ? header.vertexBlobSize > getEncodeVertexBufferBound(header.vertexCount, stride) : header.vertexBlobSize != header.vertexSize)
+        return false;
+
+      if ((header.flags & kBinaryMeshCompressIndices) != 0 ? header.indexBlobSize > getEncodeIndexBufferBound(header.indexCount) : header.indexBlobSize != header.indexSize)
+        return false;
+
+      return true;
+    }
+
+    // Reads a vertex or index blob into dst of size bytes, decoding it if it was compressed. When
+    // the reader is mapped, a compressed blob is decoded straight out of the mapping.
+    bool readBinaryMeshBlob(bx::FileReaderI* reader, MappedFileReader* mapped, bx::AllocatorI* allocator, uint8_t* dst, uint32_t size, uint32_t blobSize, bool compressed, bool indices, uint32_t count, uint32_t stride)
+    {
+      if (compressed == false)
+      {
+        return blobSize == size && bx::read(reader, dst, size) == int32_t(size);
+      }
+
+      if (mapped != nullptr && mapped->getData() != nullptr)
+      {
+        if (mapped->getSize() - mapped->getPos() < blobSize)
+          return false;
+
+        const uint8_t* blob = mapped->getData() + mapped->getPos();
+        bx::seek(reader, blobSize);
+
+        if (indices)
+          return decodeIndexBuffer((uint16_t*) dst, count, blob, blobSize);
+        return decodeVertexBuffer(dst, count, stride, blob, blobSize, allocator);
+      }
+
+      uint8_t* blob = (uint8_t*) BX_ALLOC(allocator, blobSize);
+
+      bool ok = bx::read(reader, blob, blobSize) == int32_t(blobSize);
+
+      if (ok)
+      {
+        if (indices)
+          ok = decodeIndexBuffer((uint16_t*) dst, count, blob, blobSize);
+        else
+          ok = decodeVertexBuffer(dst, count, stride, blob, blobSize, allocator);
+      }
+
+      BX_FREE(allocator, blob);
+      return ok;
+    }
+
+    // Bump when loadTextMesh would make something different from the same text.
+    const uint32_t kMeshCacheVersion = 1;
+    const size_t   kMeshCacheChunkSize = 64 * 1024;
+
+    char     _meshCacheDirectory[512];
+    uint32_t _meshCacheTemporaryCount;
+
+    inline uint64_t rotl64(uint64_t v, uint32_t r)
+    {
+      return (v << r) | (v >> (64 - r));
+    }
+
+    // Eight bytes at a time, in the style of xxHash. Hashing in pieces gives the same result as
+    // all at once, as long as every piece but the last is a multiple of eight bytes.
+    uint64_t hashBytes(uint64_t hash, const uint8_t* data, size_t size)
+    {
+      const uint64_t kPrime1 = 11400714785074694791ull;
+      const uint64_t kPrime2 = 14029467366897019727ull;
+
+      size_t i = 0;
+      for(;i + 8 <= size;i += 8)
+      {
+        uint64_t k;
+        memcpy(&k, data + i, sizeof(k));
+        hash ^= rotl64(k * kPrime2, 31) * kPrime1;
+        hash = rotl64(hash, 27) * kPrime1;
+      }
+
+      for(;i < size;i++)
+      {
+        hash ^= data[i] * kPrime1;
+        hash = rotl64(hash, 11) * kPrime2;
+      }
+
+      return hash;
+    }
+
+    // Hashes the text at path, to make the name of its cache file. False if the cache is off or
+    // the file can't be read.
+    bool getMeshCachePath(char cachePath[512], const char* path, bx::FileReaderI* reader, MappedFileReader* mapped, bx::AllocatorI* allocator)
+    {
+      size_t directoryLength = strlen(_meshCacheDirectory);
+      if (directoryLength == 0 || directoryLength + 32 > 512 || reader->open(path) != 0)
+        return false;
+
+      uint64_t hash = hashBytes(0, (const uint8_t*) &kMeshCacheVersion, sizeof(kMeshCacheVersion));
+      hash = hashBytes(hash, (const uint8_t*) &kBinaryMeshVersion, sizeof(kBinaryMeshVersion));
+      uint64_t size = 0;
+
+      if (mapped != nullptr && mapped->getData() != nullptr)
+      {
+        size = mapped->getSize();
+        hash = hashBytes(hash, mapped->getData(), mapped->getSize());
+      }
+      else
+      {
+        uint8_t* chunk = (uint8_t*) BX_ALLOC(allocator, kMeshCacheChunkSize);
+
+        int32_t read;
+        while ((read = reader->read(chunk, int32_t(kMeshCacheChunkSize))) > 0)
+        {
+          size += read;
+          hash = hashBytes(hash, chunk, read);
+        }
+
+        BX_FREE(allocator, chunk);
+      }
+
+      reader->close();
+
+      hash = hashBytes(hash, (const uint8_t*) &size, sizeof(size));
+
+      char* out = cachePath + directoryLength;
+      memcpy(cachePath, _meshCacheDirectory, directoryLength);
+      *out++ = '/';
+      for(size_t i=0;i < 16;i++)
+        *out++ = kHexDigits[(hash >> (60 - i * 4)) & 0xf];
+      strcpy(out, ".gfxm");
+      return true;
+    }
+
+    // Written under a name of its own and then renamed, so that nothing ever loads a cache file
+    // that is half written, even with several threads or processes filling the cache at once.
+    void writeMeshCache(const char* cachePath, const MeshData& meshData)
+    {
+      uint32_t count = bx::atomicFetchAndAdd(&_meshCacheTemporaryCount, 1u);
+
+      char temporaryPath[512 + 64];
+      snprintf(temporaryPath, sizeof(temporaryPath), "%s.%u.%llx.tmp", cachePath, count, (unsigned long long) bx::getHPCounter());
+
+      if (saveBinaryMesh(meshData, temporaryPath) == false || rename(temporaryPath, cachePath) != 0)
+      {
+        // where rename won't replace a file, another writer got there first with the same mesh.
+        remove(temporaryPath);
+      }
+    }
+  }
+
+  MeshData::MeshData(MeshData&& other)
+    : decl(other.decl),
+      allocator(other.allocator),
+      vertexData(other.vertexData),
+      indexData(other.indexData)
+  {
+    other.vertexData.data = nullptr;
+    other.vertexData.size = 0;
+    other.indexData.data = nullptr;
+    other.indexData.size = 0;
+  }
+
+  MeshData& MeshData::operator=(MeshData&& other)
+  {
+    if (this != &other)
+    {
+      BX_FREE(allocator, vertexData.data);
+      BX_FREE(allocator, indexData.data);
+
+      decl = other.decl;
+      allocator = other.allocator;
+      vertexData = other.vertexData;
+      indexData = other.indexData;
+
+      other.vertexData.data = nullptr;
+      other.vertexData.size = 0;
+      other.indexData.data = nullptr;
+      other.indexData.size = 0;
+    }
+    return *this;
+  }
+
+  MeshData::~MeshData()
+  {
+    BX_FREE(allocator, vertexData.data);
+    BX_FREE(allocator, indexData.data);
+  }
+
+  Mesh createMesh(const MeshData& meshData)
+  {
+    Mesh mesh;
+    mesh.vertexBuffer = bgfx::createVertexBuffer(bgfx::copy(meshData.vertexData.data, meshData.vertexData.size), meshData.decl);
+    mesh.indexBuffer.idx = bgfx::invalidHandle;
+
+    if (meshData.indexData.size > 0)
+      mesh.indexBuffer = bgfx::createIndexBuffer(bgfx::copy(meshData.indexData.data, meshData.indexData.size));
+
+    return mesh;
+  }
+
+  Mesh createMesh(MeshData&& meshData)
+  {
+    Mesh mesh;
+    mesh.vertexBuffer = bgfx::createVertexBuffer(bgfx::makeRef(meshData.vertexData.data, meshData.vertexData.size, releaseOnFrame, meshData.allocator), meshData.decl);
+    mesh.indexBuffer.idx = bgfx::invalidHandle;
+
+    if (meshData.indexData.size > 0)
+    {
+      mesh.indexBuffer = bgfx::createIndexBuffer(bgfx::makeRef(meshData.indexData.data, meshData.indexData.size, releaseOnFrame, meshData.allocator));
+    }
+    else
+    {
+      BX_FREE(meshData.allocator, meshData.indexData.data);
+    }
+
+    // bgfx owns the bytes now.
+    meshData.vertexData.data = nullptr;
+    meshData.vertexData.size = 0;
+    meshData.indexData.data = nullptr;
+    meshData.indexData.size = 0;
+
+    return mesh;
+  }
+
+  void setMeshCacheDirectory(const char* directory)
+  {
+    _meshCacheDirectory[0] = '\0';
+
+    if (directory != nullptr && strlen(directory) < sizeof(_meshCacheDirectory))
+      strcpy(_meshCacheDirectory, directory);
+  }
+
+  const char* getMeshCacheDirectory()
+  {
+    return _meshCacheDirectory[0] != '\0' ? _meshCacheDirectory : nullptr;
   }
 
   void loadTextMesh(const char* path, MeshData& meshData, bx::FileReaderI* reader)
   {
-    bx::CrtAllocator* alloc = new bx::CrtAllocator();
+    bx::AllocatorI* allocator = meshData.allocator;
 
+    MappedFileReader* mapped = nullptr;
     bool ownReader = false;
 
-#if BX_CONFIG_CRT_FILE_READER_WRITER
+#if GFX_CONFIG_MAPPED_FILE_READER
     if (reader == nullptr)
     {
-      reader = new bx::CrtFileReader();
+      mapped = BX_NEW(allocator, MappedFileReader);
+      reader = mapped;
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, bx::CrtFileReader);
       ownReader = true;
     }
 #endif
 
     size_t vertexIndex[(bgfx::Attrib::Count)] = { 0 };
 
-    if (reader->open(path) == 0)
+    // a mesh from an earlier parse of the same text is loaded instead, when there is one.
+    char cachePath[512];
+    bool useCache = getMeshCachePath(cachePath, path, reader, mapped, allocator);
+    bool cached = useCache && loadBinaryMesh(cachePath, meshData);
+
+    if (cached == false && reader->open(path) == 0)
     {
+      LineSource source;
+      source.reader = reader;
+      source.data = mapped != nullptr ? (const char*) mapped->getData() : nullptr;
+      source.pos = source.data;
+      source.end = source.data != nullptr ? source.data + mapped->getSize() : nullptr;
+
       // First pass.
       //  1. Scan through the entire file looking for decl (i.e. anything with a line with = ) in it.
       //    T. parse that line and add it to the decl, or to the index type
@@ -394,7 +994,7 @@ namespace GFX_NS
       char line[512];
       char token[64];
 
-      while (readLine(reader, line))
+      while (readLine(source, line))
       {
         if (strchr(line, '=') == nullptr)
           continue;
@@ -492,7 +1092,7 @@ namespace GFX_NS
 
       size_t stride = meshData.decl.getStride();
 
-      bx::MemoryBlock vertexMem(alloc);
+      bx::MemoryBlock vertexMem(allocator);
       bx::MemoryWriter vertexMemWriter(&vertexMem);
 
       // Second pass
@@ -507,7 +1107,7 @@ namespace GFX_NS
           continue;
 
         // Just keep 
-        reader->seek(0, bx::Whence::Enum::Begin);
+        rewind(source);
 
         uint8_t num;
         bgfx::AttribType::Enum type;
@@ -516,7 +1116,7 @@ namespace GFX_NS
         meshData.decl.decode((bgfx::Attrib::Enum) attrib, num, type, normalised, asInt);
         size_t offset = meshData.decl.getOffset((bgfx::Attrib::Enum)attrib);
 
-        while (readLine(reader, line))
+        while (readLine(source, line))
         {
           if (strchr(line, '=') != nullptr)
             continue;
@@ -578,14 +1178,14 @@ namespace GFX_NS
       }
 
       // Third pass, read all indexes
-      bx::MemoryBlock indexMem(alloc);
+      bx::MemoryBlock indexMem(allocator);
       bx::MemoryWriter indexMemWriter(&indexMem);
       size_t indexCount = 0;
       AttributeData triangleData;
 
       // Just keep 
-      reader->seek(0, bx::Whence::Enum::Begin);
-      while (readLine(reader, line))
+      rewind(source);
+      while (readLine(source, line))
       {
         if (strchr(line, '=') != nullptr)
           continue;
@@ -630,54 +1230,63 @@ namespace GFX_NS
 
 
       size_t vertexDataSize = vertexIndex[bgfx::Attrib::Position] * meshData.decl.getStride();
-      meshData.vertexData.data = (uint8_t*) BX_ALLOC(alloc, vertexDataSize);
+      meshData.vertexData.data = (uint8_t*) BX_ALLOC(allocator, vertexDataSize);
       meshData.vertexData.size = vertexDataSize;
       memcpy(meshData.vertexData.data, vertexMem.more() , vertexDataSize);
 
       size_t indexDataSize = indexCount * sizeof(uint16_t);
-      meshData.indexData.data = (uint8_t*) BX_ALLOC(alloc, indexDataSize);
+      meshData.indexData.data = (uint8_t*) BX_ALLOC(allocator, indexDataSize);
       meshData.indexData.size = indexDataSize;
       memcpy(meshData.indexData.data, indexMem.more(), indexDataSize);
       
       printf("Verts = %i, Stride = %i\n", vertexIndex[bgfx::Attrib::Position], meshData.decl.getStride());
       printf("Indexes = %i\n", indexDataSize);
 
+      reader->close();
+
+      if (useCache && vertexDataSize > 0)
+        writeMeshCache(cachePath, meshData);
     }
 
-#if BX_CONFIG_CRT_FILE_READER_WRITER
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
     if (ownReader)
     {
-      delete reader;
+      BX_DELETE(allocator, reader);
     }
 #endif
-    
-    delete alloc;
 
   }
 
-  void saveTextMesh(const MeshData& meshData, const char* path, bx::FileWriterI* writer)
+  void saveTextMesh(const MeshData& meshData, const char* path, bx::FileWriterI* writer, SaveTextMeshReport* report, bx::AllocatorI* allocator)
   {
-    saveTextMesh(meshData.decl, meshData.vertexData.data, (uint16_t*) meshData.indexData.data, meshData.vertexData.size, meshData.indexData.size, path, writer);
+    saveTextMesh(meshData.decl, meshData.vertexData.data, (uint16_t*) meshData.indexData.data, meshData.vertexData.size, meshData.indexData.size, path, writer, report, allocator);
   }
 
-  void saveTextMesh(const bgfx::VertexDecl& decl, const void* vertexData, const uint16_t* indexData, size_t vertexDataSize, size_t indexDataSize, const char* path, bx::FileWriterI* writer)
+  void saveTextMesh(const bgfx::VertexDecl& decl, const void* vertexData, const uint16_t* indexData, size_t vertexDataSize, size_t indexDataSize, const char* path, bx::FileWriterI* _writer, SaveTextMeshReport* report, bx::AllocatorI* allocator)
   {
-    char buffer[512] = { 0 };
-    
+    int64_t startTime = bx::getHPCounter();
+
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
+
     bool ownWriter = false;
 
 #if BX_CONFIG_CRT_FILE_READER_WRITER
-    if (writer == nullptr)
+    if (_writer == nullptr)
     {
-      writer = new bx::CrtFileWriter();
+      _writer = BX_NEW(allocator, bx::CrtFileWriter);
       ownWriter = true;
     }
 #endif
 
-    if (writer->open(path) == 0)
+    uint64_t bytesWritten = 0;
+
+    if (_writer->open(path) == 0)
     {
+      TextWriter writer(_writer, allocator);
+
       // human friendly vertex decl
-      saveVertexDecl(decl, writer, buffer);
+      saveVertexDecl(decl, writer);
 
       writeNewLine(writer);
 
@@ -688,9 +1297,6 @@ namespace GFX_NS
       bool normalised;
       bool asInt;
 
-      const size_t unpackMaxSize = sizeof(float) * 4;
-
-      bool wroteMarker = false;
       size_t stride = decl.getStride();
 
       for(size_t a=0;a < bgfx::Attrib::Count;a++)
@@ -725,60 +1331,38 @@ namespace GFX_NS
             lineLength = 0;
           }
 
+          // a vertex is at most four components of 12 characters, and their spaces.
+          char* dst = writer.reserve(64);
+          char* start = dst;
+
           switch(type)
           {
             case bgfx::AttribType::Uint8:
             {
               for(size_t k=0; k < num;k++)
               {
-                uint8_t c = data[k];
-                sprintf(buffer, "%02X", c);
-                writeStr(writer, buffer);
-                lineLength += strlen(buffer);
+                size_t length = formatHex(dst, data[k], 2);
+                dst += length;
+                lineLength += length;
               }
-              writeWhiteSpace(writer);
+              *dst++ = kWhiteSpaceToken;
             }
             break;
             case bgfx::AttribType::Uint10:
-            {
-              for (size_t k = 0; k < num; k++)
-              {
-                if (k > 0)
-                  writeWhiteSpace(writer);
-                int16_t c = (int16_t)_uint16[k];
-                sprintf(buffer, "%04X", c);
-                writeStr(writer, buffer);
-                lineLength += strlen(buffer);
-              }
-              writeWhiteSpace(writer);
-            }
-            break;
             case bgfx::AttribType::Int16:
-            {
-              for (size_t k = 0; k < num; k++)
-              {
-                if (k > 0)
-                  writeWhiteSpace(writer);
-                int16_t c = (int16_t) _uint16[k];
-                sprintf(buffer, "%04X", c);
-                writeStr(writer, buffer);
-                lineLength += strlen(buffer);
-              }
-              writeWhiteSpace(writer);
-            }
-            break;
             case bgfx::AttribType::Half:
             {
               for (size_t k = 0; k < num; k++)
               {
                 if (k > 0)
-                  writeWhiteSpace(writer);
-                int16_t c = (int16_t)_uint16[k];
-                sprintf(buffer, "%04X", c);
-                writeStr(writer, buffer);
-                lineLength += strlen(buffer);
+                  *dst++ = kWhiteSpaceToken;
+                // printed as a (sign extended) int, so negative values come out as FFFFxxxx.
+                int16_t c = (int16_t) _uint16[k];
+                size_t length = formatHex(dst, uint32_t(int32_t(c)), 4);
+                dst += length;
+                lineLength += length;
               }
-              writeWhiteSpace(writer);
+              *dst++ = kWhiteSpaceToken;
             }
             break;
             case bgfx::AttribType::Float:
@@ -786,18 +1370,19 @@ namespace GFX_NS
               for (size_t k = 0; k < num; k++)
               {
                 if (k > 0)
-                  writeWhiteSpace(writer);
-                float c = _float[k];
-                sprintf(buffer, "%g", c);
-                writeStr(writer, buffer);
-                lineLength += strlen(buffer);
+                  *dst++ = kWhiteSpaceToken;
+                size_t length = formatFloat(dst, _float[k]);
+                dst += length;
+                lineLength += length;
               }
-              writeWhiteSpace(writer);
-              writeWhiteSpace(writer);
+              *dst++ = kWhiteSpaceToken;
+              *dst++ = kWhiteSpaceToken;
             }
             break;
           }
 
+          writer.commit(size_t(dst - start));
+
           if (lineLength > 64)
           {
             writeNewLine(writer);
@@ -833,13 +1418,15 @@ namespace GFX_NS
             lineLength = 0;
           }
 
+          char* dst = writer.reserve(8);
+          size_t length = 0;
+
           if (i > 0)
-            writeWhiteSpace(writer);
+            dst[length++] = kWhiteSpaceToken;
 
-          int v = indexData[i];
-          sprintf(buffer, "%i", v);
-          writeStr(writer, buffer);
-          lineLength += strlen(buffer);
+          size_t digits = formatUint(dst + length, indexData[i]);
+          writer.commit(length + digits);
+          lineLength += digits;
           
           if (lineLength > 64)
           {
@@ -851,16 +1438,265 @@ namespace GFX_NS
 
       }
 
-      writer->close();
+      writer.flush();
+      bytesWritten = writer.total;
+
+      _writer->close();
+    }
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownWriter)
+    {
+      BX_DELETE(allocator, _writer);
     }
+#endif
+
+    if (report != nullptr)
+    {
+      report->bytesWritten = bytesWritten;
+      report->seconds = double(bx::getHPCounter() - startTime) / double(bx::getHPFrequency());
+      report->megabytesPerSecond = report->seconds > 0.0 ? double(bytesWritten) / (1024.0 * 1024.0) / report->seconds : 0.0;
+    }
+  }
+
+  bool loadBinaryMesh(const char* path, MeshData& meshData, bx::FileReaderI* reader)
+  {
+    bx::AllocatorI* allocator = meshData.allocator;
+    MappedFileReader* mapped = nullptr;
+    bool ownReader = false;
+    bool ok = false;
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+    if (reader == nullptr)
+    {
+      mapped = BX_NEW(allocator, MappedFileReader);
+      reader = mapped;
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, bx::CrtFileReader);
+      ownReader = true;
+    }
+#endif
+
+    if (bx::open(reader, path) == 0)
+    {
+      BinaryMeshHeader header;
+
+      if (readBinaryMeshHeader(reader, meshData.decl, header))
+      {
+        uint32_t stride = meshData.decl.getStride();
+
+        meshData.vertexData.size = header.vertexSize;
+        meshData.vertexData.data = (uint8_t*) BX_ALLOC(allocator, meshData.vertexData.size);
+        meshData.indexData.size = header.indexSize;
+        meshData.indexData.data = (uint8_t*) BX_ALLOC(allocator, meshData.indexData.size);
+
+        ok = readBinaryMeshBlob(reader, mapped, allocator, meshData.vertexData.data, meshData.vertexData.size, header.vertexBlobSize, (header.flags & kBinaryMeshCompressVertices) != 0, false, header.vertexCount, stride)
+          && readBinaryMeshBlob(reader, mapped, allocator, meshData.indexData.data, meshData.indexData.size, header.indexBlobSize, (header.flags & kBinaryMeshCompressIndices) != 0, true, header.indexCount, stride);
+
+        if (ok == false)
+        {
+          meshData = MeshData(allocator);
+        }
+      }
+
+      bx::close(reader);
+    }
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownReader)
+    {
+      BX_DELETE(allocator, reader);
+    }
+#endif
+
+    return ok;
+  }
+
+  Mesh loadBinaryMesh(const char* path, bx::FileReaderI* reader, bx::AllocatorI* allocator)
+  {
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
+
+    Mesh mesh;
+    mesh.vertexBuffer.idx = bgfx::invalidHandle;
+    mesh.indexBuffer.idx = bgfx::invalidHandle;
+
+    MappedFileReader* mapped = nullptr;
+    bool ownReader = false;
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+    if (reader == nullptr)
+    {
+      mapped = BX_NEW(allocator, MappedFileReader);
+      reader = mapped;
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, bx::CrtFileReader);
+      ownReader = true;
+    }
+#endif
+
+    if (bx::open(reader, path) == 0)
+    {
+      bgfx::VertexDecl decl;
+      BinaryMeshHeader header;
+
+      if (readBinaryMeshHeader(reader, decl, header))
+      {
+        uint32_t stride = decl.getStride();
+
+        // bgfx owns alloc'd memory once it is handed to a create call, so on a bad read the
+        // buffers are still created and then destroyed straight away to release it.
+        const bgfx::Memory* vertexMem = bgfx::alloc(header.vertexSize);
+        bool ok = readBinaryMeshBlob(reader, mapped, allocator, vertexMem->data, vertexMem->size, header.vertexBlobSize, (header.flags & kBinaryMeshCompressVertices) != 0, false, header.vertexCount, stride);
+        mesh.vertexBuffer = bgfx::createVertexBuffer(vertexMem, decl);
+
+        if (ok && header.indexCount > 0)
+        {
+          const bgfx::Memory* indexMem = bgfx::alloc(header.indexSize);
+          ok = readBinaryMeshBlob(reader, mapped, allocator, indexMem->data, indexMem->size, header.indexBlobSize, (header.flags & kBinaryMeshCompressIndices) != 0, true, header.indexCount, stride);
+          mesh.indexBuffer = bgfx::createIndexBuffer(indexMem);
+        }
+
+        if (ok == false)
+        {
+          bgfx::destroyVertexBuffer(mesh.vertexBuffer);
+          mesh.vertexBuffer.idx = bgfx::invalidHandle;
+
+          if (mesh.indexBuffer.idx != bgfx::invalidHandle)
+          {
+            bgfx::destroyIndexBuffer(mesh.indexBuffer);
+            mesh.indexBuffer.idx = bgfx::invalidHandle;
+          }
+        }
+      }
+
+      bx::close(reader);
+    }
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownReader)
+    {
+      BX_DELETE(allocator, reader);
+    }
+#endif
+
+    return mesh;
+  }
+
+  bool saveBinaryMesh(const MeshData& meshData, const char* path, uint16_t flags, bx::FileWriterI* writer, bx::AllocatorI* allocator)
+  {
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
+
+    bool ownWriter = false;
+    bool ok = false;
+
+#if BX_CONFIG_CRT_FILE_READER_WRITER
+    if (writer == nullptr)
+    {
+      writer = BX_NEW(allocator, bx::CrtFileWriter);
+      ownWriter = true;
+    }
+#endif
+
+    const bgfx::VertexDecl& decl = meshData.decl;
+    uint32_t vertexCount = uint32_t(getVertexCount(meshData));
+    uint32_t indexCount = uint32_t(getIndexCount(meshData));
+    uint16_t stride = decl.getStride();
+
+    const uint8_t* vertexBlob = meshData.vertexData.data;
+    const uint8_t* indexBlob = meshData.indexData.data;
+    uint32_t vertexBlobSize = vertexCount * stride;
+    uint32_t indexBlobSize = indexCount * sizeof(uint16_t);
+    uint8_t* vertexEncoded = nullptr;
+    uint8_t* indexEncoded = nullptr;
+
+    if (flags & kBinaryMeshCompressVertices)
+    {
+      size_t bound = getEncodeVertexBufferBound(vertexCount, stride);
+      vertexEncoded = (uint8_t*) BX_ALLOC(allocator, bound);
+      vertexBlobSize = uint32_t(encodeVertexBuffer(vertexEncoded, bound, vertexBlob, vertexCount, stride));
+      vertexBlob = vertexEncoded;
+    }
+
+    if (flags & kBinaryMeshCompressIndices)
+    {
+      size_t bound = getEncodeIndexBufferBound(indexCount);
+      indexEncoded = (uint8_t*) BX_ALLOC(allocator, bound);
+      indexBlobSize = uint32_t(encodeIndexBuffer(indexEncoded, bound, (const uint16_t*) indexBlob, indexCount));
+      indexBlob = indexEncoded;
+    }
+
+    if (bx::open(writer, path) == 0)
+    {
+      uint8_t attribCount = 0;
+      for(size_t i=0;i < bgfx::Attrib::Count;i++)
+      {
+        if (decl.has((bgfx::Attrib::Enum) i))
+          attribCount++;
+      }
+
+      bx::write(writer, kBinaryMeshMagic);
+      bx::write(writer, kBinaryMeshVersion);
+      bx::write(writer, flags);
+      bx::write(writer, stride);
+      bx::write(writer, attribCount);
+
+      // in offset order, which is the order they were added to the decl in.
+      bool written[bgfx::Attrib::Count] = { false };
+      for(size_t n=0;n < attribCount;n++)
+      {
+        size_t next = bgfx::Attrib::Count;
+        for(size_t i=0;i < bgfx::Attrib::Count;i++)
+        {
+          bgfx::Attrib::Enum attrib = (bgfx::Attrib::Enum) i;
+          if (written[i] || decl.has(attrib) == false)
+            continue;
+          if (next == bgfx::Attrib::Count || decl.getOffset(attrib) < decl.getOffset((bgfx::Attrib::Enum) next))
+            next = i;
+        }
+
+        written[next] = true;
+
+        uint8_t num;
+        bgfx::AttribType::Enum type;
+        bool normalised, asInt;
+        decl.decode((bgfx::Attrib::Enum) next, num, type, normalised, asInt);
+
+        uint8_t attrib[4] = { uint8_t(next), num, uint8_t(type), uint8_t((normalised ? 1 : 0) | (asInt ? 2 : 0)) };
+        bx::write(writer, attrib, sizeof(attrib));
+      }
+
+      bx::write(writer, vertexCount);
+      bx::write(writer, indexCount);
+      bx::write(writer, vertexBlobSize);
+      bx::write(writer, indexBlobSize);
+
+      ok = bx::write(writer, vertexBlob, vertexBlobSize) == int32_t(vertexBlobSize)
+        && bx::write(writer, indexBlob, indexBlobSize) == int32_t(indexBlobSize);
+
+      bx::close(writer);
+    }
+
+    BX_FREE(allocator, vertexEncoded);
+    BX_FREE(allocator, indexEncoded);
 
 #if BX_CONFIG_CRT_FILE_READER_WRITER
     if (ownWriter)
     {
-      delete writer;
+      BX_DELETE(allocator, writer);
     }
 #endif
 
+    return ok;
   }
 
 }
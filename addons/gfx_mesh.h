@@ -34,10 +34,15 @@ namespace bx
 namespace GFX_NS
 {
 
+  // MeshData owns its vertex and index bytes, which come from its allocator, and frees them
+  // when it goes. It can be moved but not copied, so a mesh's bytes are only ever
+  // held once on the CPU; createMesh(std::move(meshData)) then gives them to bgfx as they are.
   struct MeshData
   {
-    MeshData()
-      : decl()
+    // The bytes are allocated and freed with allocator; nullptr for getDefaultAllocator().
+    MeshData(bx::AllocatorI* _allocator = nullptr)
+      : decl(),
+        allocator(_allocator != nullptr ? _allocator : getDefaultAllocator())
     {
       vertexData.data = nullptr;
       vertexData.size = 0;
@@ -45,19 +50,88 @@ namespace GFX_NS
       indexData.size = 0;
     }
 
+    MeshData(MeshData&& other);
+    MeshData& operator=(MeshData&& other);
+    ~MeshData();
+
+    MeshData(const MeshData&) = delete;
+    MeshData& operator=(const MeshData&) = delete;
+
     bgfx::VertexDecl decl;
+    bx::AllocatorI*  allocator;
     bgfx::Memory vertexData;
     bgfx::Memory indexData;
   };
 
   //
-  void loadTextMesh(const char* path, MeshData& meshData, bx::FileReaderI* _reader = nullptr);
+  inline size_t getVertexCount(const MeshData& meshData)
+  {
+    size_t stride = meshData.decl.getStride();
+    return stride > 0 ? meshData.vertexData.size / stride : 0;
+  }
+
+  //
+  inline size_t getIndexCount(const MeshData& meshData)
+  {
+    return meshData.indexData.size / sizeof(uint16_t);
+  }
+
+  // Creates the buffers from a copy of meshData's bytes.
+  Mesh createMesh(const MeshData& meshData);
+
+  // Creates the buffers from meshData's own bytes, without copying them, and meshData is left
+  // empty. Once bgfx has uploaded them, a frame or two later, they are freed by frame() on its
+  // caller's thread (see freeOnFrame), so meshData.allocator needn't be thread safe, but it must
+  // outlive those frames.
+  Mesh createMesh(MeshData&& meshData);
+
+  // Text meshes can be cached as binary meshes, named by a hash of their text, so that a text is
+  // only parsed the first time it is seen. Set the directory, which must exist, before anything
+  // is loaded; nullptr, the default, turns the cache off.
+  void setMeshCacheDirectory(const char* directory);
 
   //
-  void saveTextMesh(const bgfx::VertexDecl& decl, const void* vertexData, const uint16_t* indexData, size_t vertexDataSize, size_t indexDataSize, const char* path, bx::FileWriterI* _writer = nullptr);
+  const char* getMeshCacheDirectory();
+
+  // The bytes, and any reader that is made, come from meshData.allocator. With a cache directory,
+  // the text is hashed first and its cached binary mesh is loaded if there is one; otherwise the
+  // text is parsed and the cache written.
+  void loadTextMesh(const char* path, MeshData& meshData, bx::FileReaderI* _reader = nullptr);
+
+  struct SaveTextMeshReport
+  {
+    uint64_t bytesWritten;
+    double   seconds;             // including opening and closing the file
+    double   megabytesPerSecond;
+  };
+
+  // The text is built in large blocks and written a block at a time, so writers don't need
+  // their own buffering. The block comes from _allocator, or getDefaultAllocator() if it is nullptr.
+  void saveTextMesh(const bgfx::VertexDecl& decl, const void* vertexData, const uint16_t* indexData, size_t vertexDataSize, size_t indexDataSize, const char* path, bx::FileWriterI* _writer = nullptr, SaveTextMeshReport* report = nullptr, bx::AllocatorI* _allocator = nullptr);
 
   //
-  void saveTextMesh(const MeshData& meshData, const char* path, bx::FileWriterI* _writer = nullptr);
+  void saveTextMesh(const MeshData& meshData, const char* path, bx::FileWriterI* _writer = nullptr, SaveTextMeshReport* report = nullptr, bx::AllocatorI* _allocator = nullptr);
+
+  // Binary mesh; a header, the vertex decl and the vertex and index data, each of which may be
+  // compressed with gfx_mesh_codec.
+  //  'GFXM' uint32, version uint16, flags uint16 (kBinaryMesh*), stride uint16, attribute count uint8
+  //  per attribute; attrib uint8, num uint8, type uint8, normalised | asInt << 1 uint8
+  //  vertex count uint32, index count uint32, vertex blob size uint32, index blob size uint32
+  //  vertex blob, index blob
+  static const uint16_t kBinaryMeshCompressVertices = 1 << 0;
+  static const uint16_t kBinaryMeshCompressIndices  = 1 << 1;
+  static const uint16_t kBinaryMeshCompress         = kBinaryMeshCompressVertices | kBinaryMeshCompressIndices;
+
+  // Allocates from meshData.allocator.
+  bool loadBinaryMesh(const char* path, MeshData& meshData, bx::FileReaderI* _reader = nullptr);
+
+  // Loads a binary mesh straight into bgfx::alloc memory and creates its buffers, without going
+  // through a MeshData. Returns invalid handles on failure. Scratch memory for decoding comes
+  // from _allocator, or getDefaultAllocator() if it is nullptr.
+  Mesh loadBinaryMesh(const char* path, bx::FileReaderI* _reader = nullptr, bx::AllocatorI* _allocator = nullptr);
+
+  // The compressed blobs are built in memory from _allocator, or getDefaultAllocator().
+  bool saveBinaryMesh(const MeshData& meshData, const char* path, uint16_t flags = kBinaryMeshCompress, bx::FileWriterI* _writer = nullptr, bx::AllocatorI* _allocator = nullptr);
 
 }
 
@@ -0,0 +1,379 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mesh_codec.h"
+
+#include <bx/allocator.h>
+#include <bx/uint32_t.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    const uint8_t kIndexCodecHeader  = 0xe0 | 1;
+    const uint8_t kVertexCodecHeader = 0xa0 | 1;
+
+    const size_t   kMinMatch       = 4;
+    const size_t   kMaxOffset      = 65535;
+    const uint32_t kHashBits       = 14;
+    const size_t   kUnfilterBlock  = 1024; // vertices per prefix sum block, keeps the output in cache
+
+    uint32_t read32(const uint8_t* p)
+    {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    size_t getLzBound(size_t size)
+    {
+      return size + size / 255 + 16;
+    }
+
+    uint8_t* writeLength(uint8_t* op, const uint8_t* opEnd, size_t length)
+    {
+      while (length >= 255)
+      {
+        if (op == opEnd)
+          return nullptr;
+        *op++ = 255;
+        length -= 255;
+      }
+
+      if (op == opEnd)
+        return nullptr;
+      *op++ = (uint8_t) length;
+      return op;
+    }
+
+    const uint8_t* readLength(const uint8_t* ip, const uint8_t* ipEnd, size_t& length)
+    {
+      uint8_t b;
+      do
+      {
+        if (ip == ipEnd)
+          return nullptr;
+        b = *ip++;
+        length += b;
+      }
+      while (b == 255);
+
+      return ip;
+    }
+
+    // token, [literal length], literals, and unless it is the last sequence; offset, [match length].
+    uint8_t* writeSequence(uint8_t* op, const uint8_t* opEnd, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+      if (op == opEnd)
+        return nullptr;
+
+      size_t matchCode = matchLength > 0 ? matchLength - kMinMatch : 0;
+      uint8_t* token = op++;
+      *token = uint8_t((bx::uint32_min(uint32_t(literalLength), 15) << 4) | bx::uint32_min(uint32_t(matchCode), 15));
+
+      if (literalLength >= 15 && (op = writeLength(op, opEnd, literalLength - 15)) == nullptr)
+        return nullptr;
+
+      if (size_t(opEnd - op) < literalLength)
+        return nullptr;
+      memcpy(op, literals, literalLength);
+      op += literalLength;
+
+      if (matchLength == 0)
+        return op;
+
+      if (opEnd - op < 2)
+        return nullptr;
+      *op++ = uint8_t(offset & 0xff);
+      *op++ = uint8_t(offset >> 8);
+
+      if (matchCode >= 15 && (op = writeLength(op, opEnd, matchCode - 15)) == nullptr)
+        return nullptr;
+
+      return op;
+    }
+
+    size_t lzCompress(uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize)
+    {
+      GFX_VECTOR<uint32_t> table;
+      table.resize(size_t(1) << kHashBits);
+      memset(&table[0], 0, sizeof(uint32_t) * table.size());
+
+      const uint8_t* ip = src;
+      const uint8_t* anchor = src;
+      const uint8_t* end = src + srcSize;
+      uint8_t* op = dst;
+      const uint8_t* opEnd = dst + dstSize;
+
+      while (ip + kMinMatch <= end)
+      {
+        uint32_t sequence = read32(ip);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+
+        // positions are stored + 1, so 0 is an empty slot.
+        uint32_t candidate = table[hash];
+        table[hash] = uint32_t(ip - src) + 1;
+
+        if (candidate != 0)
+        {
+          const uint8_t* ref = src + candidate - 1;
+
+          if (size_t(ip - ref) <= kMaxOffset && read32(ref) == sequence)
+          {
+            size_t length = kMinMatch;
+            while (ip + length < end && ref[length] == ip[length])
+              length++;
+
+            op = writeSequence(op, opEnd, anchor, ip - anchor, ip - ref, length);
+            if (op == nullptr)
+              return 0;
+
+            ip += length;
+            anchor = ip;
+            continue;
+          }
+        }
+
+        ip++;
+      }
+
+      op = writeSequence(op, opEnd, anchor, end - anchor, 0, 0);
+      return op != nullptr ? size_t(op - dst) : 0;
+    }
+
+    bool lzDecompress(uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize)
+    {
+      const uint8_t* ip = src;
+      const uint8_t* ipEnd = src + srcSize;
+      uint8_t* op = dst;
+      uint8_t* opEnd = dst + dstSize;
+
+      while (ip < ipEnd)
+      {
+        uint8_t token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && (ip = readLength(ip, ipEnd, literalLength)) == nullptr)
+          return false;
+
+        if (size_t(ipEnd - ip) < literalLength || size_t(opEnd - op) < literalLength)
+          return false;
+
+        memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+
+        if (ip == ipEnd)
+          break; // last sequence has no match.
+
+        if (ipEnd - ip < 2)
+          return false;
+
+        size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+        ip += 2;
+
+        size_t matchLength = (token & 15);
+        if (matchLength == 15 && (ip = readLength(ip, ipEnd, matchLength)) == nullptr)
+          return false;
+        matchLength += kMinMatch;
+
+        if (offset == 0 || offset > size_t(op - dst) || size_t(opEnd - op) < matchLength)
+          return false;
+
+        const uint8_t* ref = op - offset;
+
+        if (offset >= 8 && size_t(opEnd - op) >= matchLength + 8)
+        {
+          // eight bytes at a time, running over the end is fine as there is room and it gets overwritten.
+          for(size_t i=0;i < matchLength;i += 8)
+            memcpy(op + i, ref + i, 8);
+        }
+        else
+        {
+          for(size_t i=0;i < matchLength;i++)
+            op[i] = ref[i];
+        }
+
+        op += matchLength;
+      }
+
+      return op == opEnd;
+    }
+  }
+
+  size_t getEncodeIndexBufferBound(size_t indexCount)
+  {
+    // a zigzag delta of 16 bit indices needs at most 17 bits, three bytes of seven.
+    return 1 + indexCount * 3;
+  }
+
+  size_t encodeIndexBuffer(uint8_t* dst, size_t dstSize, const uint16_t* indices, size_t indexCount)
+  {
+    if (dstSize < 1)
+      return 0;
+
+    uint8_t* op = dst;
+    const uint8_t* opEnd = dst + dstSize;
+
+    *op++ = kIndexCodecHeader;
+
+    int32_t previous = 0;
+    for(size_t i=0;i < indexCount;i++)
+    {
+      int32_t delta = int32_t(indices[i]) - previous;
+      uint32_t v = (uint32_t(delta) << 1) ^ uint32_t(delta >> 31);
+      previous = indices[i];
+
+      do
+      {
+        if (op == opEnd)
+          return 0;
+
+        uint8_t b = v & 0x7f;
+        v >>= 7;
+        *op++ = b | (v != 0 ? 0x80 : 0);
+      }
+      while (v != 0);
+    }
+
+    return size_t(op - dst);
+  }
+
+  bool decodeIndexBuffer(uint16_t* dst, size_t indexCount, const uint8_t* src, size_t srcSize)
+  {
+    if (srcSize < 1 || src[0] != kIndexCodecHeader)
+      return false;
+
+    const uint8_t* ip = src + 1;
+    const uint8_t* ipEnd = src + srcSize;
+
+    int32_t previous = 0;
+    for(size_t i=0;i < indexCount;i++)
+    {
+      uint32_t v = 0;
+      uint32_t shift = 0;
+      uint8_t b;
+
+      do
+      {
+        if (ip == ipEnd || shift > 14)
+          return false;
+
+        b = *ip++;
+        v |= uint32_t(b & 0x7f) << shift;
+        shift += 7;
+      }
+      while (b & 0x80);
+
+      int32_t delta = int32_t(v >> 1) ^ -int32_t(v & 1);
+      previous += delta;
+      dst[i] = uint16_t(previous);
+    }
+
+    return ip == ipEnd;
+  }
+
+  size_t getEncodeVertexBufferBound(size_t vertexCount, size_t stride)
+  {
+    return 1 + getLzBound(vertexCount * stride);
+  }
+
+  size_t encodeVertexBuffer(uint8_t* dst, size_t dstSize, const void* vertices, size_t vertexCount, size_t stride)
+  {
+    if (dstSize < 1)
+      return 0;
+
+    size_t size = vertexCount * stride;
+    const uint8_t* src = (const uint8_t*) vertices;
+
+    GFX_VECTOR<uint8_t> filtered;
+    filtered.resize(size + 1);
+
+    // plane k holds byte k of every vertex, as the difference to the vertex before it.
+    for(size_t k=0;k < stride;k++)
+    {
+      uint8_t* plane = &filtered[k * vertexCount];
+      uint8_t previous = 0;
+
+      for(size_t v=0;v < vertexCount;v++)
+      {
+        uint8_t b = src[v * stride + k];
+        plane[v] = uint8_t(b - previous);
+        previous = b;
+      }
+    }
+
+    dst[0] = kVertexCodecHeader;
+    size_t written = lzCompress(dst + 1, dstSize - 1, &filtered[0], size);
+
+    return written > 0 ? written + 1 : 0;
+  }
+
+  bool decodeVertexBuffer(void* dst, size_t vertexCount, size_t stride, const uint8_t* src, size_t srcSize, bx::AllocatorI* allocator)
+  {
+    if (srcSize < 1 || src[0] != kVertexCodecHeader)
+      return false;
+
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
+
+    size_t size = vertexCount * stride;
+
+    uint8_t* planes = (uint8_t*) BX_ALLOC(allocator, size + stride);
+
+    bool ok = lzDecompress(planes, size, src + 1, srcSize - 1);
+
+    if (ok)
+    {
+      uint8_t* out = (uint8_t*) dst;
+      uint8_t* running = planes + size; // per plane sum, carried across blocks
+      memset(running, 0, stride);
+
+      for(size_t block=0;block < vertexCount;block += kUnfilterBlock)
+      {
+        size_t blockEnd = bx::uint32_min(uint32_t(vertexCount), uint32_t(block + kUnfilterBlock));
+
+        for(size_t k=0;k < stride;k++)
+        {
+          const uint8_t* plane = planes + k * vertexCount;
+          uint8_t* o = out + k;
+          uint8_t sum = running[k];
+
+          for(size_t v=block;v < blockEnd;v++)
+          {
+            sum += plane[v];
+            o[v * stride] = sum;
+          }
+
+          running[k] = sum;
+        }
+      }
+    }
+
+    BX_FREE(allocator, planes);
+
+    return ok;
+  }
+
+}
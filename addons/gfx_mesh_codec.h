@@ -0,0 +1,61 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESH_CODEC_H
+#define GFX_MESH_CODEC_H
+
+#include "gfx.h"
+
+namespace GFX_NS
+{
+
+  // Index buffers are stored as the zigzag encoded difference to the previous index, as a
+  // LEB128 style varint; an optimised triangle list mostly needs one byte per index.
+
+  //
+  size_t getEncodeIndexBufferBound(size_t indexCount);
+
+  // Returns the number of bytes written to dst, or 0 if dstSize was too small.
+  size_t encodeIndexBuffer(uint8_t* dst, size_t dstSize, const uint16_t* indices, size_t indexCount);
+
+  // Returns false if src is malformed or does not hold exactly indexCount indices.
+  bool decodeIndexBuffer(uint16_t* dst, size_t indexCount, const uint8_t* src, size_t srcSize);
+
+  // Vertex buffers are transposed into byte planes (byte k of every vertex), each plane is
+  // delta filtered against the previous vertex, and the result is packed with a small LZ77
+  // codec in the style of LZ4. Decoding is a branch-light copy loop followed by a prefix sum
+  // over cache sized blocks of vertices, written straight into the destination.
+
+  //
+  size_t getEncodeVertexBufferBound(size_t vertexCount, size_t stride);
+
+  // Returns the number of bytes written to dst, or 0 if dstSize was too small.
+  size_t encodeVertexBuffer(uint8_t* dst, size_t dstSize, const void* vertices, size_t vertexCount, size_t stride);
+
+  // Returns false if src is malformed or does not hold exactly vertexCount vertices. The byte
+  // planes are decoded into scratch memory from allocator, or getDefaultAllocator().
+  bool decodeVertexBuffer(void* dst, size_t vertexCount, size_t stride, const uint8_t* src, size_t srcSize, bx::AllocatorI* allocator = nullptr);
+
+}
+
+#endif
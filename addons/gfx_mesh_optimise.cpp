@@ -0,0 +1,489 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mesh_optimise.h"
+
+#include <bx/allocator.h>
+#include <bx/fpumath.h>
+#include <stdlib.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    // FIFO cache simulation. A vertex is in the cache if fewer than cacheSize misses have
+    // happened since it was last loaded, so flushing the cache is just a jump in time.
+    struct VertexCache
+    {
+      GFX_VECTOR<uint32_t> timestamps;
+      uint32_t time;
+      uint32_t size;
+
+      void reset(size_t vertexCount, uint32_t cacheSize)
+      {
+        timestamps.resize(vertexCount);
+        memset(&timestamps[0], 0, sizeof(uint32_t) * vertexCount);
+        size = cacheSize;
+        time = cacheSize + 1;
+      }
+
+      void flush()
+      {
+        time += size + 1;
+      }
+
+      uint32_t touch(uint16_t v)
+      {
+        if (time - timestamps[v] > size)
+        {
+          timestamps[v] = time++;
+          return 1;
+        }
+        return 0;
+      }
+
+      uint32_t touchTriangle(const uint16_t* tri)
+      {
+        return touch(tri[0]) + touch(tri[1]) + touch(tri[2]);
+      }
+    };
+
+    struct Cluster
+    {
+      size_t start, end; // in triangles
+      float  sortKey;
+    };
+
+    int compareClusters(const void* a, const void* b)
+    {
+      const Cluster* ca = (const Cluster*) a;
+      const Cluster* cb = (const Cluster*) b;
+
+      if (ca->sortKey > cb->sortKey)
+        return -1;
+      if (ca->sortKey < cb->sortKey)
+        return 1;
+
+      // keep the original order for equal keys, so the output is deterministic.
+      if (ca->start != cb->start)
+        return ca->start < cb->start ? -1 : 1;
+
+      return 0;
+    }
+
+    void unpackPositions(GFX_VECTOR<float>& positions, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount)
+    {
+      positions.resize(vertexCount * 3);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float p[4];
+        bgfx::vertexUnpack(p, bgfx::Attrib::Position, decl, vertexData, i);
+        positions[i * 3 + 0] = p[0];
+        positions[i * 3 + 1] = p[1];
+        positions[i * 3 + 2] = p[2];
+      }
+    }
+
+    const uint32_t kEmptySlot = UINT32_MAX;
+
+    // murmur3's 32 bit mix, a word at a time.
+    uint32_t hashBytes(const uint8_t* data, size_t size)
+    {
+      uint32_t h = 0x9747b28c;
+      size_t i = 0;
+
+      for(;i + 4 <= size;i += 4)
+      {
+        uint32_t k;
+        memcpy(&k, data + i, sizeof(k));
+        k *= 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+      }
+
+      for(;i < size;i++)
+        h = (h ^ data[i]) * 0x01000193;
+
+      h ^= h >> 16;
+      h *= 0x85ebca6b;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35;
+      h ^= h >> 16;
+      return h;
+    }
+
+    // The hash is kept beside the index, so most probes don't have to look at the vertex itself.
+    struct WeldSlot
+    {
+      uint32_t hash;
+      uint32_t index;
+    };
+  }
+
+  float getVertexCacheMissRatio(const uint16_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+  {
+    size_t triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+      return 0.0f;
+
+    VertexCache cache;
+    cache.reset(vertexCount, cacheSize);
+
+    size_t misses = 0;
+    for(size_t i=0;i < triangleCount;i++)
+    {
+      misses += cache.touchTriangle(&indices[i * 3]);
+    }
+
+    return float(misses) / float(triangleCount);
+  }
+
+  float getVertexCacheMissRatio(const MeshData& meshData, uint32_t cacheSize)
+  {
+    return getVertexCacheMissRatio((const uint16_t*) meshData.indexData.data, getIndexCount(meshData), getVertexCount(meshData), cacheSize);
+  }
+
+  void optimiseOverdraw(uint16_t* destination, const uint16_t* indices, size_t indexCount, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, float threshold, uint32_t cacheSize)
+  {
+    size_t triangleCount = indexCount / 3;
+
+    if (triangleCount == 0 || decl.has(bgfx::Attrib::Position) == false)
+      return;
+
+    GFX_VECTOR<Cluster> clusters;
+    VertexCache cache;
+    cache.reset(vertexCount, cacheSize);
+
+    // 1. Hard boundaries; wherever a triangle misses on all three vertices the cache was
+    //    effectively cold, so drawing from there on in another order costs nothing extra.
+    //    The first cluster always starts at 0, whether or not the first triangle misses on
+    //    all three; a degenerate one such as 0,0,1 can't.
+    GFX_VECTOR<size_t> hard;
+    hard.push_back(0);
+    for(size_t i=0;i < triangleCount;i++)
+    {
+      if (cache.touchTriangle(&indices[i * 3]) == 3 && i > 0)
+        hard.push_back(i);
+    }
+    hard.push_back(triangleCount);
+
+    // 2. Soft boundaries; split a hard cluster further as long as each piece, drawn from
+    //    a cold cache, stays within threshold of the whole hard cluster's miss ratio.
+    for(size_t h=0;h + 1 < hard.size();h++)
+    {
+      size_t start = hard[h], end = hard[h + 1];
+
+      cache.flush();
+      size_t clusterMisses = 0;
+      for(size_t i=start;i < end;i++)
+        clusterMisses += cache.touchTriangle(&indices[i * 3]);
+
+      float limit = threshold * float(clusterMisses) / float(end - start);
+
+      cache.flush();
+      size_t misses = 0;
+      size_t softStart = start;
+      for(size_t i=start;i < end;i++)
+      {
+        misses += cache.touchTriangle(&indices[i * 3]);
+
+        size_t triangles = i + 1 - softStart;
+        if (i + 1 < end && float(misses) <= limit * float(triangles))
+        {
+          Cluster cluster = { softStart, i + 1, 0.0f };
+          clusters.push_back(cluster);
+          softStart = i + 1;
+          misses = 0;
+          cache.flush();
+        }
+      }
+
+      Cluster cluster = { softStart, end, 0.0f };
+      clusters.push_back(cluster);
+    }
+
+    // 3. Sort key; clusters that sit far out from the middle of the mesh and face away from it
+    //    are the likeliest occluders, so use the distance of the cluster's centroid along its
+    //    average normal relative to the mesh's centroid.
+    GFX_VECTOR<float> positions;
+    unpackPositions(positions, decl, vertexData, vertexCount);
+
+    GFX_VECTOR<float> clusterData;
+    clusterData.resize(clusters.size() * 6);
+
+    float meshCentroid[3] = { 0, 0, 0 };
+    float meshArea = 0.0f;
+
+    for(size_t c=0;c < clusters.size();c++)
+    {
+      float centroid[3] = { 0, 0, 0 };
+      float normal[3] = { 0, 0, 0 };
+      float clusterArea = 0.0f;
+
+      for(size_t i=clusters[c].start;i < clusters[c].end;i++)
+      {
+        const float* p0 = &positions[indices[i * 3 + 0] * 3];
+        const float* p1 = &positions[indices[i * 3 + 1] * 3];
+        const float* p2 = &positions[indices[i * 3 + 2] * 3];
+
+        float e0[3], e1[3], n[3];
+        bx::vec3Sub(e0, p1, p0);
+        bx::vec3Sub(e1, p2, p0);
+        bx::vec3Cross(n, e0, e1);
+
+        // twice the area; the constant factor cancels out.
+        float area = bx::vec3Length(n);
+
+        for(size_t k=0;k < 3;k++)
+        {
+          centroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+          normal[k] += n[k];
+        }
+
+        clusterArea += area;
+      }
+
+      if (clusterArea > 0.0f)
+      {
+        bx::vec3Mul(centroid, centroid, 1.0f / clusterArea);
+      }
+
+      float normalLength = bx::vec3Length(normal);
+      if (normalLength > 0.0f)
+      {
+        bx::vec3Mul(normal, normal, 1.0f / normalLength);
+      }
+
+      memcpy(&clusterData[c * 6 + 0], centroid, sizeof(float) * 3);
+      memcpy(&clusterData[c * 6 + 3], normal, sizeof(float) * 3);
+
+      for(size_t k=0;k < 3;k++)
+        meshCentroid[k] += centroid[k] * clusterArea;
+      meshArea += clusterArea;
+    }
+
+    if (meshArea > 0.0f)
+    {
+      bx::vec3Mul(meshCentroid, meshCentroid, 1.0f / meshArea);
+    }
+
+    for(size_t c=0;c < clusters.size();c++)
+    {
+      float d[3];
+      bx::vec3Sub(d, &clusterData[c * 6 + 0], meshCentroid);
+      clusters[c].sortKey = bx::vec3Dot(d, &clusterData[c * 6 + 3]);
+    }
+
+    qsort(&clusters[0], clusters.size(), sizeof(Cluster), compareClusters);
+
+    // 4. Emit, through a copy so destination and indices may overlap.
+    GFX_VECTOR<uint16_t> source;
+    source.resize(triangleCount * 3);
+    memcpy(&source[0], indices, sizeof(uint16_t) * triangleCount * 3);
+
+    uint16_t* out = destination;
+    for(size_t c=0;c < clusters.size();c++)
+    {
+      size_t count = (clusters[c].end - clusters[c].start) * 3;
+      memcpy(out, &source[clusters[c].start * 3], sizeof(uint16_t) * count);
+      out += count;
+    }
+  }
+
+  void optimiseOverdraw(MeshData& meshData, float threshold, uint32_t cacheSize)
+  {
+    uint16_t* indices = (uint16_t*) meshData.indexData.data;
+    optimiseOverdraw(indices, indices, getIndexCount(meshData), meshData.decl, meshData.vertexData.data, getVertexCount(meshData), threshold, cacheSize);
+  }
+
+  size_t generateVertexRemap(uint32_t* remap, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, const WeldSettings& settings)
+  {
+    if (vertexCount == 0)
+      return 0;
+
+    bool exact = true;
+    size_t attribCount = 0;
+    for(size_t a=0;a < bgfx::Attrib::Count;a++)
+    {
+      if (decl.has(bgfx::Attrib::Enum(a)) == false)
+        continue;
+
+      attribCount++;
+      if (settings.epsilon[a] > 0.0f)
+        exact = false;
+    }
+
+    // Exact welds compare the vertices as they are. Otherwise each vertex gets a key of four
+    // words per attribute, the unpacked values or the grid cells they fall in, and that is
+    // what is hashed and compared.
+    const uint8_t* keys = (const uint8_t*) vertexData;
+    size_t keySize = decl.getStride();
+    GFX_VECTOR<uint32_t> keyData;
+
+    if (exact == false)
+    {
+      keySize = attribCount * sizeof(uint32_t) * 4;
+      keyData.resize(vertexCount * attribCount * 4);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        uint32_t* key = &keyData[i * attribCount * 4];
+
+        for(size_t a=0;a < bgfx::Attrib::Count;a++)
+        {
+          bgfx::Attrib::Enum attrib = bgfx::Attrib::Enum(a);
+          if (decl.has(attrib) == false)
+            continue;
+
+          float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+          bgfx::vertexUnpack(v, attrib, decl, vertexData, i);
+
+          if (settings.epsilon[a] > 0.0f)
+          {
+            float scale = 1.0f / settings.epsilon[a];
+            for(size_t k=0;k < 4;k++)
+            {
+              float cell = bx::fmin(bx::fmax(floorf(v[k] * scale + 0.5f), -1e9f), 1e9f);
+              v[k] = cell + 0.0f; // no -0
+            }
+          }
+
+          memcpy(key, v, sizeof(v));
+          key += 4;
+        }
+      }
+
+      keys = (const uint8_t*) &keyData[0];
+    }
+
+    // a power of two, at most half full.
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+      tableSize <<= 1;
+
+    GFX_VECTOR<WeldSlot> table;
+    table.resize(tableSize);
+    memset(&table[0], 0xff, sizeof(WeldSlot) * tableSize);
+
+    size_t mask = tableSize - 1;
+    size_t uniqueCount = 0;
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      const uint8_t* key = keys + i * keySize;
+      uint32_t hash = hashBytes(key, keySize);
+      size_t slot = hash & mask;
+
+      for(;;)
+      {
+        WeldSlot& s = table[slot];
+
+        if (s.index == kEmptySlot)
+        {
+          s.hash = hash;
+          s.index = uint32_t(i);
+          remap[i] = uint32_t(uniqueCount++);
+          break;
+        }
+
+        if (s.hash == hash && memcmp(keys + s.index * keySize, key, keySize) == 0)
+        {
+          remap[i] = remap[s.index];
+          break;
+        }
+
+        slot = (slot + 1) & mask;
+      }
+    }
+
+    return uniqueCount;
+  }
+
+  bool weldVertices(MeshData& meshData, const WeldSettings& settings, WeldReport* report)
+  {
+    size_t vertexCount = getVertexCount(meshData);
+    size_t indexCount = getIndexCount(meshData);
+    size_t stride = meshData.decl.getStride();
+
+    GFX_VECTOR<uint32_t> remap;
+    remap.resize(vertexCount + 1);
+    size_t uniqueCount = generateVertexRemap(&remap[0], meshData.decl, meshData.vertexData.data, vertexCount, settings);
+
+    if (uniqueCount > UINT16_MAX + 1)
+      return false;
+
+    bx::AllocatorI* allocator = meshData.allocator;
+
+    uint8_t* vertexData = (uint8_t*) BX_ALLOC(allocator, uniqueCount * stride);
+    const uint8_t* oldVertexData = meshData.vertexData.data;
+
+    // remap only ever points back, so the first vertex to get a new index is the one kept.
+    size_t next = 0;
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      if (remap[i] == next)
+      {
+        memcpy(vertexData + next * stride, oldVertexData + i * stride, stride);
+        next++;
+      }
+    }
+
+    // without an index buffer, the vertices were drawn as a list; the index buffer is that list.
+    bool hadIndices = indexCount > 0;
+    size_t newIndexCount = hadIndices ? indexCount : vertexCount;
+
+    uint16_t* indexData = (uint16_t*) BX_ALLOC(allocator, newIndexCount * sizeof(uint16_t));
+    const uint16_t* oldIndices = (const uint16_t*) meshData.indexData.data;
+
+    for(size_t i=0;i < newIndexCount;i++)
+      indexData[i] = uint16_t(remap[hadIndices ? oldIndices[i] : i]);
+
+    uint32_t oldSize = meshData.vertexData.size + meshData.indexData.size;
+
+    BX_FREE(allocator, meshData.vertexData.data);
+    BX_FREE(allocator, meshData.indexData.data);
+
+    meshData.vertexData.data = vertexData;
+    meshData.vertexData.size = uint32_t(uniqueCount * stride);
+    meshData.indexData.data = (uint8_t*) indexData;
+    meshData.indexData.size = uint32_t(newIndexCount * sizeof(uint16_t));
+
+    if (report != nullptr)
+    {
+      report->oldVertexCount = uint32_t(vertexCount);
+      report->newVertexCount = uint32_t(uniqueCount);
+      report->oldSize = oldSize;
+      report->newSize = meshData.vertexData.size + meshData.indexData.size;
+      report->bytesSaved = int32_t(report->oldSize) - int32_t(report->newSize);
+    }
+
+    return true;
+  }
+
+}
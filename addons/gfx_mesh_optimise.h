@@ -0,0 +1,91 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESH_OPTIMISE_H
+#define GFX_MESH_OPTIMISE_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  // Size of the post-transform vertex cache the optimisers simulate.
+  static const uint32_t kDefaultVertexCacheSize = 16;
+
+  // Average number of vertex cache misses per triangle (ACMR) for a uint16 triangle list,
+  // simulated with a FIFO cache of cacheSize entries. 0.5 is the ideal, 3.0 the worst case.
+  float getVertexCacheMissRatio(const uint16_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = kDefaultVertexCacheSize);
+
+  //
+  float getVertexCacheMissRatio(const MeshData& meshData, uint32_t cacheSize = kDefaultVertexCacheSize);
+
+  // Reorders the triangles of an already vertex cache optimised index buffer, so that clusters
+  // which are likely to occlude the rest of the mesh are drawn first.
+  //
+  // The index buffer is split into clusters at points where the cache is cold, and each cluster
+  // may be split further as long as its miss ratio stays under threshold times the original.
+  // A threshold of 1.05 allows the vertex cache efficiency to get at most 5% worse.
+  //
+  // destination may be the same as indices.
+  void optimiseOverdraw(uint16_t* destination, const uint16_t* indices, size_t indexCount, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = kDefaultVertexCacheSize);
+
+  //
+  void optimiseOverdraw(MeshData& meshData, float threshold = 1.05f, uint32_t cacheSize = kDefaultVertexCacheSize);
+
+  struct WeldSettings
+  {
+    WeldSettings()
+    {
+      memset(epsilon, 0, sizeof(epsilon));
+    }
+
+    // Per attribute. 0 compares the attribute's bytes exactly, otherwise values are snapped to a
+    // grid of this size before comparing; two values within epsilon of each other usually, but
+    // not always (when they sit either side of a grid line), weld.
+    float epsilon[bgfx::Attrib::Count];
+  };
+
+  struct WeldReport
+  {
+    uint32_t oldVertexCount;
+    uint32_t newVertexCount;
+    uint32_t oldSize;        // vertex and index data, in bytes
+    uint32_t newSize;
+    int32_t  bytesSaved;     // negative if the added index buffer costs more than the welding saved
+  };
+
+  // Finds the unique vertices of vertexData, by hashing whole vertices into an open addressing
+  // table. remap[i] is the new index of vertex i; unique vertices keep their order, so the first
+  // vertex of a duplicate set is the one kept. Returns the number of unique vertices.
+  size_t generateVertexRemap(uint32_t* remap, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, const WeldSettings& settings = WeldSettings());
+
+  // Removes duplicate vertices from meshData. The index buffer is remapped, or if there is none,
+  // one is made; meshData can then be drawn with an index buffer in place of the duplicated
+  // vertex list. Returns false, and leaves meshData as it is, when there would be more than
+  // 65535 vertices left for a uint16 index buffer.
+  bool weldVertices(MeshData& meshData, const WeldSettings& settings = WeldSettings(), WeldReport* report = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,507 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mesh_quantise.h"
+
+#include <bx/allocator.h>
+#include <bx/uint32_t.h>
+#include <bx/fpumath.h>
+#include <float.h>
+
+#if BX_CPU_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define GFX_QUANTISE_SSE2 1
+#else
+# define GFX_QUANTISE_SSE2 0
+#endif
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    enum AttribKind
+    {
+      kCopy,
+      kPosition,
+      kOctahedral,
+      kHalf
+    };
+
+    // Size in bytes of an attribute as laid out by the decl, including any padding bgfx added.
+    uint16_t getAttribSize(const bgfx::VertexDecl& decl, bgfx::Attrib::Enum attrib)
+    {
+      uint16_t offset = decl.getOffset(attrib);
+      uint16_t end = decl.getStride();
+
+      for(size_t i=0;i < bgfx::Attrib::Count;i++)
+      {
+        bgfx::Attrib::Enum other = static_cast<bgfx::Attrib::Enum>(i);
+        if (other == attrib || decl.has(other) == false)
+          continue;
+
+        uint16_t otherOffset = decl.getOffset(other);
+        if (otherOffset > offset && otherOffset < end)
+          end = otherOffset;
+      }
+
+      return end - offset;
+    }
+
+    // count floats to half, round to nearest even.
+    void convertFloatToHalf(uint16_t* dst, const float* src, size_t count)
+    {
+      size_t i = 0;
+
+#if GFX_QUANTISE_SSE2
+      // branchless float to half of four values at a time, after Fabian Giesen's float_to_half_fast3.
+      const __m128i signMask      = _mm_set1_epi32(0x80000000);
+      const __m128i halfMax       = _mm_set1_epi32((127 + 16) << 23);
+      const __m128i nanBit        = _mm_set1_epi32(0x200);
+      const __m128i infinity      = _mm_set1_epi32(0x7c00);
+      const __m128i minNormal     = _mm_set1_epi32((127 - 14) << 23);
+      const __m128i subnormMagic  = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+      const __m128i normalBias    = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+      for(;i + 4 <= count;i += 4)
+      {
+        __m128  f           = _mm_loadu_ps(&src[i]);
+        __m128  sign        = _mm_and_ps(_mm_castsi128_ps(signMask), f);
+        __m128  absf        = _mm_xor_ps(f, sign);
+        __m128i absi        = _mm_castps_si128(absf);
+        __m128  isNan       = _mm_cmpunord_ps(absf, absf);
+        __m128i isRegular   = _mm_cmpgt_epi32(halfMax, absi);
+        __m128i special     = _mm_or_si128(_mm_and_si128(_mm_castps_si128(isNan), nanBit), infinity);
+        __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absi);
+
+        __m128i subnormal   = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(subnormMagic))), subnormMagic);
+
+        __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+        __m128i normal      = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, normalBias), mantissaOdd), 13);
+
+        __m128i finite      = _mm_or_si128(_mm_and_si128(subnormal, isSubnormal), _mm_andnot_si128(isSubnormal, normal));
+        __m128i joined      = _mm_or_si128(_mm_and_si128(finite, isRegular), _mm_andnot_si128(isRegular, special));
+        __m128i result      = _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+
+        // the sign extension above keeps every lane within int16, so the saturating pack is exact.
+        _mm_storel_epi64((__m128i*) &dst[i], _mm_packs_epi32(result, result));
+      }
+#endif
+
+      for(;i < count;i++)
+      {
+        dst[i] = bx::halfFromFloat(src[i]);
+      }
+    }
+
+    // count floats in [-1, 1] to int16 normalised.
+    void convertFloatToSnorm16(int16_t* dst, const float* src, size_t count)
+    {
+      size_t i = 0;
+
+#if GFX_QUANTISE_SSE2
+      const __m128 scale = _mm_set1_ps(32767.0f);
+      const __m128 lo    = _mm_set1_ps(-32767.0f);
+      const __m128 hi    = _mm_set1_ps(32767.0f);
+
+      for(;i + 8 <= count;i += 8)
+      {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 0]), scale), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale), lo), hi);
+        _mm_storeu_si128((__m128i*) &dst[i], _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+      }
+#endif
+
+      for(;i < count;i++)
+      {
+        dst[i] = (int16_t) bx::fround(bx::fclamp(src[i], -1.0f, 1.0f) * 32767.0f);
+      }
+    }
+
+    float decodeSnorm16(int16_t v)
+    {
+      return bx::fmax(float(v) / 32767.0f, -1.0f);
+    }
+
+    void octahedralEncode(float out[2], const float n[3])
+    {
+      float length = bx::fabsolute(n[0]) + bx::fabsolute(n[1]) + bx::fabsolute(n[2]);
+
+      if (length == 0.0f)
+      {
+        out[0] = 0.0f;
+        out[1] = 0.0f;
+        return;
+      }
+
+      float x = n[0] / length;
+      float y = n[1] / length;
+
+      if (n[2] < 0.0f)
+      {
+        float ox = (1.0f - bx::fabsolute(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float oy = (1.0f - bx::fabsolute(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = ox;
+        y = oy;
+      }
+
+      out[0] = x;
+      out[1] = y;
+    }
+
+    void octahedralDecode(float out[3], const float e[2])
+    {
+      float n[3] = { e[0], e[1], 1.0f - bx::fabsolute(e[0]) - bx::fabsolute(e[1]) };
+
+      if (n[2] < 0.0f)
+      {
+        float x = (1.0f - bx::fabsolute(n[1])) * (n[0] >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - bx::fabsolute(n[0])) * (n[1] >= 0.0f ? 1.0f : -1.0f);
+        n[0] = x;
+        n[1] = y;
+      }
+
+      bx::vec3Norm(out, n);
+    }
+
+    float quantisePosition(MeshData& meshData, uint8_t* dst, const bgfx::VertexDecl& decl, size_t vertexCount, PositionQuantisation format, Matrix& dequantise)
+    {
+      GFX_VECTOR<float> stream;
+      stream.resize(vertexCount * 4);
+
+      float minimum[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+      float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = &stream[i * 4];
+        bgfx::vertexUnpack(p, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+        bx::vec3Min(minimum, minimum, p);
+        bx::vec3Max(maximum, maximum, p);
+      }
+
+      float centre[3], halfExtents[3];
+      bx::vec3Add(centre, minimum, maximum);
+      bx::vec3Mul(centre, centre, 0.5f);
+      bx::vec3Sub(halfExtents, maximum, minimum);
+      bx::vec3Mul(halfExtents, halfExtents, 0.5f);
+
+      // uniform, so normals are not skewed by the dequantise transform.
+      float extent = bx::fmax(halfExtents[0], bx::fmax(halfExtents[1], halfExtents[2]));
+      if (extent <= 0.0f)
+        extent = 1.0f;
+
+      float invExtent = 1.0f / extent;
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = &stream[i * 4];
+        bx::vec3Sub(p, p, centre);
+        bx::vec3Mul(p, p, invExtent);
+        p[3] = 1.0f;
+      }
+
+      dequantise = Matrix::Scale(extent) * Matrix::Translate(centre[0], centre[1], centre[2]);
+
+      GFX_VECTOR<uint16_t> packed;
+      packed.resize(vertexCount * 4);
+
+      if (format == PositionQuantisation::Half)
+        convertFloatToHalf(&packed[0], &stream[0], stream.size());
+      else
+        convertFloatToSnorm16((int16_t*) &packed[0], &stream[0], stream.size());
+
+      size_t stride = decl.getStride();
+      size_t offset = decl.getOffset(bgfx::Attrib::Position);
+
+      float error = 0.0f;
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        const uint16_t* q = &packed[i * 4];
+        memcpy(dst + i * stride + offset, q, sizeof(uint16_t) * 4);
+
+        float original[4], decoded[3];
+        bgfx::vertexUnpack(original, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+
+        for(size_t k=0;k < 3;k++)
+        {
+          float v = (format == PositionQuantisation::Half) ? bx::halfToFloat(q[k]) : decodeSnorm16((int16_t) q[k]);
+          decoded[k] = v * extent + centre[k];
+        }
+
+        float d[3];
+        bx::vec3Sub(d, decoded, original);
+        error = bx::fmax(error, bx::vec3Length(d));
+      }
+
+      return error;
+    }
+
+    float quantiseOctahedral(MeshData& meshData, uint8_t* dst, const bgfx::VertexDecl& decl, size_t vertexCount, bgfx::Attrib::Enum attrib, NormalQuantisation format)
+    {
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      decl.decode(attrib, num, type, normalised, asInt);
+
+      size_t stride = decl.getStride();
+      size_t offset = decl.getOffset(attrib);
+
+      float maxError = 0.0f;
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float v[4], n[3];
+        bgfx::vertexUnpack(v, attrib, meshData.decl, meshData.vertexData.data, i);
+
+        if (bx::vec3Length(v) > 0.0f)
+          bx::vec3Norm(n, v);
+        else
+          bx::vec3Move(n, Vector::PosZ.ptr());
+
+        float e[2], q[2], decoded[3];
+        octahedralEncode(e, n);
+
+        uint8_t* out = dst + i * stride + offset;
+        float handedness = v[3] < 0.0f ? -1.0f : 1.0f;
+
+        if (format == NormalQuantisation::Uint8)
+        {
+          for(size_t k=0;k < 2;k++)
+          {
+            uint8_t u = (uint8_t) bx::fround(bx::fclamp(e[k] * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f);
+            out[k] = u;
+            q[k] = float(u) / 255.0f * 2.0f - 1.0f;
+          }
+
+          if (num == 4)
+          {
+            out[2] = handedness < 0.0f ? 0 : 255;
+            out[3] = 0;
+          }
+        }
+        else
+        {
+          int16_t s[4] = { 0, 0, 0, 0 };
+          convertFloatToSnorm16(s, e, 2);
+          q[0] = decodeSnorm16(s[0]);
+          q[1] = decodeSnorm16(s[1]);
+
+          if (num == 4)
+            s[2] = handedness < 0.0f ? -32767 : 32767;
+
+          memcpy(out, s, sizeof(int16_t) * num);
+        }
+
+        octahedralDecode(decoded, q);
+
+        float error = bx::facos(bx::fclamp(bx::vec3Dot(decoded, n), -1.0f, 1.0f));
+        maxError = bx::fmax(maxError, error);
+      }
+
+      return maxError;
+    }
+
+    float quantiseHalf(MeshData& meshData, uint8_t* dst, const bgfx::VertexDecl& decl, size_t vertexCount, bgfx::Attrib::Enum attrib)
+    {
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      decl.decode(attrib, num, type, normalised, asInt);
+
+      GFX_VECTOR<float> stream;
+      stream.resize(vertexCount * num);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float v[4];
+        bgfx::vertexUnpack(v, attrib, meshData.decl, meshData.vertexData.data, i);
+        memcpy(&stream[i * num], v, sizeof(float) * num);
+      }
+
+      GFX_VECTOR<uint16_t> packed;
+      packed.resize(vertexCount * num);
+      convertFloatToHalf(&packed[0], &stream[0], stream.size());
+
+      size_t stride = decl.getStride();
+      size_t offset = decl.getOffset(attrib);
+
+      float maxError = 0.0f;
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        memcpy(dst + i * stride + offset, &packed[i * num], sizeof(uint16_t) * num);
+
+        float error = 0.0f;
+        for(size_t k=0;k < num;k++)
+        {
+          float d = bx::halfToFloat(packed[i * num + k]) - stream[i * num + k];
+          error += d * d;
+        }
+
+        maxError = bx::fmax(maxError, bx::fsqrt(error));
+      }
+
+      return maxError;
+    }
+  }
+
+  void quantiseMesh(MeshData& meshData, const QuantiseSettings& settings, QuantiseReport* report)
+  {
+    const bgfx::VertexDecl& oldDecl = meshData.decl;
+    size_t vertexCount = getVertexCount(meshData);
+
+    if (vertexCount == 0)
+      return;
+
+    // 1. Build the compact decl, attributes keep their order.
+    AttribKind kinds[bgfx::Attrib::Count];
+    bgfx::VertexDecl decl;
+    decl.begin();
+
+    for(size_t i=0;i < bgfx::Attrib::Count;i++)
+    {
+      bgfx::Attrib::Enum attrib = static_cast<bgfx::Attrib::Enum>(i);
+
+      kinds[i] = kCopy;
+
+      if (oldDecl.has(attrib) == false)
+        continue;
+
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      oldDecl.decode(attrib, num, type, normalised, asInt);
+
+      if (type == bgfx::AttribType::Float && asInt == false)
+      {
+        switch(attrib)
+        {
+          default: break;
+          case bgfx::Attrib::Position:
+          {
+            kinds[i] = kPosition;
+            if (settings.position == PositionQuantisation::Half)
+              decl.add(attrib, 4, bgfx::AttribType::Half);
+            else
+              decl.add(attrib, 4, bgfx::AttribType::Int16, true);
+          }
+          continue;
+          case bgfx::Attrib::Normal:
+          case bgfx::Attrib::Tangent:
+          case bgfx::Attrib::Bitangent:
+          {
+            kinds[i] = kOctahedral;
+            uint8_t octNum = (attrib == bgfx::Attrib::Tangent && num == 4) ? 4 : 2;
+            if (settings.normal == NormalQuantisation::Uint8)
+              decl.add(attrib, octNum, bgfx::AttribType::Uint8, true);
+            else
+              decl.add(attrib, octNum, bgfx::AttribType::Int16, true);
+          }
+          continue;
+          case bgfx::Attrib::TexCoord0:
+          case bgfx::Attrib::TexCoord1:
+          case bgfx::Attrib::TexCoord2:
+          case bgfx::Attrib::TexCoord3:
+          case bgfx::Attrib::TexCoord4:
+          case bgfx::Attrib::TexCoord5:
+          case bgfx::Attrib::TexCoord6:
+          case bgfx::Attrib::TexCoord7:
+          {
+            if (settings.texCoords)
+            {
+              kinds[i] = kHalf;
+              decl.add(attrib, num, bgfx::AttribType::Half);
+              continue;
+            }
+          }
+          break;
+        }
+      }
+
+      decl.add(attrib, num, type, normalised, asInt);
+    }
+
+    decl.end();
+
+    // 2. Convert.
+    bx::AllocatorI* allocator = meshData.allocator;
+    size_t stride = decl.getStride();
+    uint8_t* vertexData = (uint8_t*) BX_ALLOC(allocator, vertexCount * stride);
+    memset(vertexData, 0, vertexCount * stride);
+
+    QuantiseReport result;
+    result.oldStride = oldDecl.getStride();
+    result.newStride = decl.getStride();
+
+    for(size_t i=0;i < bgfx::Attrib::Count;i++)
+    {
+      bgfx::Attrib::Enum attrib = static_cast<bgfx::Attrib::Enum>(i);
+
+      if (oldDecl.has(attrib) == false)
+        continue;
+
+      switch(kinds[i])
+      {
+        case kCopy:
+        {
+          uint16_t size = getAttribSize(oldDecl, attrib);
+          size_t srcOffset = oldDecl.getOffset(attrib), dstOffset = decl.getOffset(attrib);
+          size_t srcStride = oldDecl.getStride();
+
+          for(size_t v=0;v < vertexCount;v++)
+            memcpy(vertexData + v * stride + dstOffset, meshData.vertexData.data + v * srcStride + srcOffset, size);
+        }
+        break;
+        case kPosition:
+        {
+          result.error[i] = quantisePosition(meshData, vertexData, decl, vertexCount, settings.position, result.dequantise);
+        }
+        break;
+        case kOctahedral:
+        {
+          result.error[i] = quantiseOctahedral(meshData, vertexData, decl, vertexCount, attrib, settings.normal);
+        }
+        break;
+        case kHalf:
+        {
+          result.error[i] = quantiseHalf(meshData, vertexData, decl, vertexCount, attrib);
+        }
+        break;
+      }
+    }
+
+    BX_FREE(allocator, meshData.vertexData.data);
+
+    meshData.decl = decl;
+    meshData.vertexData.data = vertexData;
+    meshData.vertexData.size = vertexCount * stride;
+
+    if (report != nullptr)
+    {
+      *report = result;
+    }
+  }
+
+}
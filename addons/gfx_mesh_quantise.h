@@ -0,0 +1,98 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESH_QUANTISE_H
+#define GFX_MESH_QUANTISE_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  enum class PositionQuantisation
+  {
+    Half,  // 4 half, w = 1
+    Int16  // 4 int16 normalised, w = 1
+  };
+
+  enum class NormalQuantisation
+  {
+    Uint8, // 2 uint8 normalised, octahedral
+    Int16  // 2 int16 normalised, octahedral
+  };
+
+  struct QuantiseSettings
+  {
+    QuantiseSettings()
+      : position(PositionQuantisation::Int16),
+        normal(NormalQuantisation::Uint8),
+        texCoords(true)
+    {
+    }
+
+    PositionQuantisation position;
+    NormalQuantisation   normal;   // used for normal, tangent and bitangent
+    bool                 texCoords; // float texcoords become half
+  };
+
+  struct QuantiseReport
+  {
+    QuantiseReport()
+      : oldStride(0),
+        newStride(0)
+    {
+      memset(error, 0, sizeof(error));
+    }
+
+    // Positions are stored centred and scaled into [-1, 1]. This takes them back to the original
+    // model space, so it goes before the model matrix; matrices apply to row vectors, left to
+    // right, so that is setModelMatrix(report.dequantise * getModelMatrix()), not
+    // multiplyModelMatrix, which would apply it after the model.
+    Matrix dequantise;
+
+    // Largest error per attribute over all vertices. For positions and texcoords this is the
+    // distance in original units, for normal, tangent and bitangent it is the angle in radians.
+    // Attributes that were copied as-is report 0.
+    float error[bgfx::Attrib::Count];
+
+    uint16_t oldStride, newStride;
+  };
+
+  // Rewrites the vertices of meshData into a compact decl;
+  //   position                      -> half or int16 normalised, with a dequantise transform
+  //   normal, tangent, bitangent    -> octahedral encoded in uint8 or int16 normalised;
+  //                                    a 4 component tangent keeps its handedness in z.
+  //   float texcoords               -> half
+  // Every other attribute is copied through unchanged. Only float sources are quantised.
+  //
+  // Octahedral attributes need to be decoded in the vertex shader, e.g.
+  //   vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  //   if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy);
+  //   n = normalize(n);
+  // where e is in [-1, 1] (uint8 needs e = e * 2.0 - 1.0 first).
+  void quantiseMesh(MeshData& meshData, const QuantiseSettings& settings = QuantiseSettings(), QuantiseReport* report = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,595 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mesh_simplify.h"
+
+#include <bx/allocator.h>
+#include <bx/fpumath.h>
+#include <bx/uint32_t.h>
+#include <float.h>
+#include <stdlib.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    const uint32_t kInvalid = UINT32_MAX;
+    const size_t   kMaxAttributes = 5; // normal xyz + texcoord0 uv
+
+    struct Quadric
+    {
+      float a00, a11, a22, a01, a02, a12;
+      float b0, b1, b2;
+      float c;
+      float w;
+
+      void zero()
+      {
+        memset(this, 0, sizeof(Quadric));
+      }
+
+      void addPlane(const float n[3], float d, float weight)
+      {
+        a00 += weight * n[0] * n[0];
+        a11 += weight * n[1] * n[1];
+        a22 += weight * n[2] * n[2];
+        a01 += weight * n[0] * n[1];
+        a02 += weight * n[0] * n[2];
+        a12 += weight * n[1] * n[2];
+        b0  += weight * n[0] * d;
+        b1  += weight * n[1] * d;
+        b2  += weight * n[2] * d;
+        c   += weight * d * d;
+        w   += weight;
+      }
+
+      void add(const Quadric& q)
+      {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a01 += q.a01; a02 += q.a02; a12 += q.a12;
+        b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+        c   += q.c;
+        w   += q.w;
+      }
+
+      // mean squared distance of p to the accumulated planes.
+      float error(const float p[3]) const
+      {
+        float x = p[0], y = p[1], z = p[2];
+        float e = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0f * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0f * (b0 * x + b1 * y + b2 * z)
+                + c;
+        return w > 0.0f ? bx::fabsolute(e) / w : 0.0f;
+      }
+    };
+
+    struct Collapse
+    {
+      uint32_t from, to;
+      float    cost;  // geometric error plus attribute penalty, orders the collapses
+      float    error; // geometric error only
+    };
+
+    int compareCollapses(const void* a, const void* b)
+    {
+      float ca = ((const Collapse*) a)->cost;
+      float cb = ((const Collapse*) b)->cost;
+      return ca < cb ? -1 : (ca > cb ? 1 : 0);
+    }
+
+    uint32_t hashUint32(uint32_t h)
+    {
+      h ^= h >> 16;
+      h *= 0x85ebca6b;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35;
+      h ^= h >> 16;
+      return h;
+    }
+
+    size_t hashTableSize(size_t count)
+    {
+      size_t size = 1;
+      while (size < count + count / 4)
+        size *= 2;
+      return size;
+    }
+
+    // Gives every vertex the id of the first vertex with a bitwise identical position.
+    void buildPositionGroups(GFX_VECTOR<uint32_t>& group, const float* positions, size_t vertexCount)
+    {
+      size_t tableSize = hashTableSize(vertexCount);
+      GFX_VECTOR<uint32_t> table;
+      table.resize(tableSize);
+      memset(&table[0], 0xff, sizeof(uint32_t) * tableSize);
+
+      group.resize(vertexCount);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        const float* p = &positions[i * 3];
+        uint32_t bits[3];
+        memcpy(bits, p, sizeof(bits));
+
+        uint32_t h = hashUint32(bits[0] ^ hashUint32(bits[1] ^ hashUint32(bits[2])));
+        size_t slot = h & (tableSize - 1);
+
+        while (table[slot] != kInvalid && memcmp(&positions[table[slot] * 3], p, sizeof(float) * 3) != 0)
+          slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == kInvalid)
+          table[slot] = (uint32_t) i;
+
+        group[i] = table[slot];
+      }
+    }
+
+    // Locks every vertex that sits on an attribute seam or on an open border.
+    void buildLocks(GFX_VECTOR<uint8_t>& locked, const GFX_VECTOR<uint32_t>& group, const uint16_t* indices, size_t indexCount, size_t vertexCount)
+    {
+      locked.resize(vertexCount);
+      memset(&locked[0], 0, vertexCount);
+
+      GFX_VECTOR<uint32_t> groupSize;
+      groupSize.resize(vertexCount);
+      memset(&groupSize[0], 0, sizeof(uint32_t) * vertexCount);
+
+      for(size_t i=0;i < vertexCount;i++)
+        groupSize[group[i]]++;
+
+      // directed edges between position groups; an edge with no twin is a border.
+      size_t tableSize = hashTableSize(indexCount);
+      GFX_VECTOR<uint64_t> edges;
+      edges.resize(tableSize);
+      memset(&edges[0], 0xff, sizeof(uint64_t) * tableSize);
+
+      for(size_t pass=0;pass < 2;pass++)
+      {
+        for(size_t i=0;i < indexCount;i += 3)
+        {
+          for(size_t e=0;e < 3;e++)
+          {
+            uint32_t a = group[indices[i + e]];
+            uint32_t b = group[indices[i + (e + 1) % 3]];
+
+            uint64_t key = pass == 0 ? ((uint64_t(a) << 32) | b) : ((uint64_t(b) << 32) | a);
+            size_t slot = hashUint32(uint32_t(key) ^ hashUint32(uint32_t(key >> 32))) & (tableSize - 1);
+
+            while (edges[slot] != UINT64_MAX && edges[slot] != key)
+              slot = (slot + 1) & (tableSize - 1);
+
+            if (pass == 0)
+            {
+              edges[slot] = key;
+            }
+            else if (edges[slot] == UINT64_MAX)
+            {
+              locked[a] = 1;
+              locked[b] = 1;
+            }
+          }
+        }
+      }
+
+      // locks were set per group leader above, spread them to every member.
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        if (groupSize[group[i]] > 1 || locked[group[i]])
+          locked[i] = 1;
+      }
+    }
+
+    void triangleNormal(float n[3], const float* p0, const float* p1, const float* p2)
+    {
+      float e0[3], e1[3];
+      bx::vec3Sub(e0, p1, p0);
+      bx::vec3Sub(e1, p2, p0);
+      bx::vec3Cross(n, e0, e1);
+    }
+  }
+
+  size_t simplifyMesh(uint16_t* destination, const uint16_t* indices, size_t indexCount, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, size_t targetIndexCount, float targetError, float attributeWeight, float* resultError)
+  {
+    if (resultError != nullptr)
+      *resultError = 0.0f;
+
+    if (indexCount <= targetIndexCount || vertexCount == 0 || decl.has(bgfx::Attrib::Position) == false)
+    {
+      memmove(destination, indices, sizeof(uint16_t) * indexCount);
+      return indexCount;
+    }
+
+    GFX_VECTOR<uint16_t> result;
+    result.resize(indexCount);
+    memcpy(&result[0], indices, sizeof(uint16_t) * indexCount);
+
+    // 1. Positions, scaled into a unit box so the error is relative to the mesh size.
+    GFX_VECTOR<float> positions;
+    positions.resize(vertexCount * 3);
+
+    float minimum[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      float v[4];
+      bgfx::vertexUnpack(v, bgfx::Attrib::Position, decl, vertexData, i);
+      memcpy(&positions[i * 3], v, sizeof(float) * 3);
+      bx::vec3Min(minimum, minimum, v);
+      bx::vec3Max(maximum, maximum, v);
+    }
+
+    float extent = bx::fmax(maximum[0] - minimum[0], bx::fmax(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+    float invExtent = extent > 0.0f ? 1.0f / extent : 0.0f;
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      float* p = &positions[i * 3];
+      bx::vec3Sub(p, p, minimum);
+      bx::vec3Mul(p, p, invExtent);
+    }
+
+    // 2. Attributes taken into account by the cost.
+    size_t attributeCount = 0;
+    GFX_VECTOR<float> attributes;
+    bool hasNormal = decl.has(bgfx::Attrib::Normal);
+    bool hasTexCoord = decl.has(bgfx::Attrib::TexCoord0);
+
+    if (attributeWeight > 0.0f && (hasNormal || hasTexCoord))
+    {
+      attributeCount = (hasNormal ? 3 : 0) + (hasTexCoord ? 2 : 0);
+      attributes.resize(vertexCount * kMaxAttributes);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* a = &attributes[i * kMaxAttributes];
+        float v[4];
+        size_t k = 0;
+
+        if (hasNormal)
+        {
+          bgfx::vertexUnpack(v, bgfx::Attrib::Normal, decl, vertexData, i);
+          a[k++] = v[0]; a[k++] = v[1]; a[k++] = v[2];
+        }
+
+        if (hasTexCoord)
+        {
+          bgfx::vertexUnpack(v, bgfx::Attrib::TexCoord0, decl, vertexData, i);
+          a[k++] = v[0]; a[k++] = v[1];
+        }
+      }
+    }
+
+    // 3. Topology.
+    GFX_VECTOR<uint32_t> group;
+    GFX_VECTOR<uint8_t> locked;
+    buildPositionGroups(group, &positions[0], vertexCount);
+    buildLocks(locked, group, &result[0], indexCount, vertexCount);
+
+    // 4. Area weighted plane quadrics per vertex.
+    GFX_VECTOR<Quadric> quadrics;
+    quadrics.resize(vertexCount);
+    for(size_t i=0;i < vertexCount;i++)
+      quadrics[i].zero();
+
+    for(size_t i=0;i < indexCount;i += 3)
+    {
+      const float* p0 = &positions[result[i + 0] * 3];
+      const float* p1 = &positions[result[i + 1] * 3];
+      const float* p2 = &positions[result[i + 2] * 3];
+
+      float n[3];
+      triangleNormal(n, p0, p1, p2);
+
+      float area = bx::vec3Length(n);
+      if (area <= 0.0f)
+        continue;
+
+      bx::vec3Mul(n, n, 1.0f / area);
+      float d = -bx::vec3Dot(n, p0);
+
+      for(size_t k=0;k < 3;k++)
+        quadrics[result[i + k]].addPlane(n, d, area);
+    }
+
+    // 5. Collapse in passes; each pass picks the cheapest collapses that don't touch each other.
+    float maxCost = targetError * targetError;
+    float worstError = 0.0f;
+    size_t triangleCount = indexCount / 3;
+    size_t targetTriangleCount = targetIndexCount / 3;
+
+    GFX_VECTOR<uint32_t> adjacencyOffsets, adjacency, remap;
+    GFX_VECTOR<uint8_t> touched;
+    GFX_VECTOR<Collapse> collapses;
+
+    adjacencyOffsets.resize(vertexCount + 1);
+    remap.resize(vertexCount);
+    touched.resize(vertexCount);
+
+    while (triangleCount > targetTriangleCount)
+    {
+      // vertex to triangle adjacency of the current index list.
+      memset(&adjacencyOffsets[0], 0, sizeof(uint32_t) * (vertexCount + 1));
+      for(size_t i=0;i < triangleCount * 3;i++)
+        adjacencyOffsets[result[i] + 1]++;
+      for(size_t i=0;i < vertexCount;i++)
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+
+      adjacency.resize(triangleCount * 3);
+      for(size_t i=0;i < triangleCount * 3;i++)
+        adjacency[adjacencyOffsets[result[i]]++] = uint32_t(i / 3);
+      for(size_t i=vertexCount;i > 0;i--)
+        adjacencyOffsets[i] = adjacencyOffsets[i - 1];
+      adjacencyOffsets[0] = 0;
+
+      // candidates, in both directions of every edge.
+      collapses.clear();
+      for(size_t i=0;i < triangleCount * 3;i += 3)
+      {
+        for(size_t e=0;e < 3;e++)
+        {
+          uint32_t a = result[i + e];
+          uint32_t b = result[i + (e + 1) % 3];
+
+          if (a > b)
+            continue;
+
+          for(size_t dir=0;dir < 2;dir++)
+          {
+            uint32_t from = dir == 0 ? a : b;
+            uint32_t to   = dir == 0 ? b : a;
+
+            if (locked[from])
+              continue;
+
+            float error = quadrics[from].error(&positions[to * 3]);
+            float cost = error;
+
+            if (attributeCount > 0)
+            {
+              float distance = 0.0f;
+              for(size_t k=0;k < attributeCount;k++)
+              {
+                float d = attributes[from * kMaxAttributes + k] - attributes[to * kMaxAttributes + k];
+                distance += d * d;
+              }
+              cost += attributeWeight * distance;
+            }
+
+            if (cost > maxCost)
+              continue;
+
+            Collapse collapse = { from, to, cost, error };
+            collapses.push_back(collapse);
+          }
+        }
+      }
+
+      if (collapses.empty())
+        break;
+
+      qsort(&collapses[0], collapses.size(), sizeof(Collapse), compareCollapses);
+
+      for(size_t i=0;i < vertexCount;i++)
+        remap[i] = uint32_t(i);
+      memset(&touched[0], 0, vertexCount);
+
+      size_t collapsed = 0;
+      size_t remaining = triangleCount;
+
+      for(size_t c=0;c < collapses.size() && remaining > targetTriangleCount;c++)
+      {
+        const Collapse& collapse = collapses[c];
+        uint32_t from = collapse.from, to = collapse.to;
+
+        if (touched[from] || touched[to])
+          continue;
+
+        // reject collapses that would flip a triangle around from.
+        bool flips = false;
+        size_t removed = 0;
+        for(uint32_t t=adjacencyOffsets[from];t < adjacencyOffsets[from + 1] && flips == false;t++)
+        {
+          const uint16_t* tri = &result[adjacency[t] * 3];
+
+          if (tri[0] == to || tri[1] == to || tri[2] == to)
+          {
+            removed++;
+            continue;
+          }
+
+          const float* p[3];
+          const float* q[3];
+          for(size_t k=0;k < 3;k++)
+          {
+            p[k] = &positions[tri[k] * 3];
+            q[k] = tri[k] == from ? &positions[to * 3] : p[k];
+          }
+
+          float before[3], after[3];
+          triangleNormal(before, p[0], p[1], p[2]);
+          triangleNormal(after, q[0], q[1], q[2]);
+
+          if (bx::vec3Dot(before, after) <= 0.0f)
+            flips = true;
+        }
+
+        if (flips)
+          continue;
+
+        remap[from] = to;
+        quadrics[to].add(quadrics[from]);
+
+        // the neighbourhood changed, it gets evaluated again in the next pass.
+        for(uint32_t t=adjacencyOffsets[from];t < adjacencyOffsets[from + 1];t++)
+        {
+          const uint16_t* tri = &result[adjacency[t] * 3];
+          touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+        }
+
+        worstError = bx::fmax(worstError, collapse.error);
+        remaining -= bx::uint32_min(uint32_t(remaining), uint32_t(removed));
+        collapsed++;
+      }
+
+      if (collapsed == 0)
+        break;
+
+      // apply the pass, dropping triangles that became degenerate.
+      size_t write = 0;
+      for(size_t i=0;i < triangleCount * 3;i += 3)
+      {
+        uint16_t a = (uint16_t) remap[result[i + 0]];
+        uint16_t b = (uint16_t) remap[result[i + 1]];
+        uint16_t c = (uint16_t) remap[result[i + 2]];
+
+        if (a == b || b == c || c == a)
+          continue;
+
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+
+      triangleCount = write / 3;
+    }
+
+    memcpy(destination, &result[0], sizeof(uint16_t) * triangleCount * 3);
+
+    if (resultError != nullptr)
+      *resultError = bx::fsqrt(worstError);
+
+    return triangleCount * 3;
+  }
+
+  void generateLods(MeshData& meshData, const float* ratios, size_t ratioCount, GFX_VECTOR<MeshLod>& lods, float maxError, float attributeWeight)
+  {
+    lods.clear();
+
+    size_t indexCount = getIndexCount(meshData);
+    size_t vertexCount = getVertexCount(meshData);
+
+    if (indexCount == 0)
+      return;
+
+    float extent = 0.0f;
+    {
+      float minimum[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+      float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float v[4];
+        bgfx::vertexUnpack(v, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+        bx::vec3Min(minimum, minimum, v);
+        bx::vec3Max(maximum, maximum, v);
+      }
+      extent = bx::fmax(maximum[0] - minimum[0], bx::fmax(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+    }
+
+    GFX_VECTOR<uint16_t> chain;
+    chain.resize(indexCount);
+    memcpy(&chain[0], meshData.indexData.data, sizeof(uint16_t) * indexCount);
+
+    MeshLod base = { 0, uint32_t(indexCount), 0.0f };
+    lods.push_back(base);
+
+    GFX_VECTOR<uint16_t> level;
+    float relativeError = 0.0f;
+
+    for(size_t r=0;r < ratioCount;r++)
+    {
+      const MeshLod& previous = lods.back();
+      size_t target = size_t(float(indexCount) * ratios[r]) / 3 * 3;
+
+      level.resize(previous.indexCount);
+      float levelError = 0.0f;
+      size_t levelCount = simplifyMesh(&level[0], &chain[previous.firstIndex], previous.indexCount, meshData.decl, meshData.vertexData.data, vertexCount, target, maxError - relativeError, attributeWeight, &levelError);
+
+      // each level is simplified from the last one, so their errors add up.
+      relativeError += levelError;
+
+      if (levelCount == 0 || levelCount >= previous.indexCount)
+        break;
+
+      MeshLod lod = { uint32_t(chain.size()), uint32_t(levelCount), relativeError * extent };
+      chain.resize(chain.size() + levelCount);
+      memcpy(&chain[lod.firstIndex], &level[0], sizeof(uint16_t) * levelCount);
+      lods.push_back(lod);
+
+      if (levelCount > target + target / 4)
+        break; // hit maxError before reaching the ratio; further levels can't do better.
+    }
+
+    bx::AllocatorI* allocator = meshData.allocator;
+    BX_FREE(allocator, meshData.indexData.data);
+    meshData.indexData.size = uint32_t(chain.size() * sizeof(uint16_t));
+    meshData.indexData.data = (uint8_t*) BX_ALLOC(allocator, meshData.indexData.size);
+    memcpy(meshData.indexData.data, &chain[0], meshData.indexData.size);
+  }
+
+  LodMesh createLodMesh(const MeshData& meshData, const MeshLod* lods, size_t lodCount)
+  {
+    LodMesh mesh;
+    memset(&mesh, 0, sizeof(LodMesh));
+
+    size_t vertexCount = getVertexCount(meshData);
+
+    // bounding box centre, then the furthest vertex from it.
+    float minimum[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      float v[4];
+      bgfx::vertexUnpack(v, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+      bx::vec3Min(minimum, minimum, v);
+      bx::vec3Max(maximum, maximum, v);
+    }
+
+    if (vertexCount > 0)
+    {
+      bx::vec3Add(mesh.centre, minimum, maximum);
+      bx::vec3Mul(mesh.centre, mesh.centre, 0.5f);
+    }
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      float v[4], d[3];
+      bgfx::vertexUnpack(v, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+      bx::vec3Sub(d, v, mesh.centre);
+      mesh.radius = bx::fmax(mesh.radius, bx::vec3Length(d));
+    }
+
+    mesh.lodCount = (uint8_t) bx::uint32_min(uint32_t(lodCount), kMaxMeshLods);
+    memcpy(mesh.lods, lods, sizeof(MeshLod) * mesh.lodCount);
+    mesh.currentLod = 0;
+
+    mesh.vertexBuffer = bgfx::createVertexBuffer(bgfx::copy(meshData.vertexData.data, meshData.vertexData.size), meshData.decl);
+    mesh.indexBuffer = bgfx::createIndexBuffer(bgfx::copy(meshData.indexData.data, meshData.indexData.size));
+
+    return mesh;
+  }
+
+}
@@ -0,0 +1,58 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESH_SIMPLIFY_H
+#define GFX_MESH_SIMPLIFY_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  // Reduces a triangle list to roughly targetIndexCount indices by collapsing edges with the
+  // lowest quadric error onto one of their existing vertices, so the result still indexes the
+  // original vertex buffer.
+  //
+  // Vertices on open borders and on attribute seams (several vertices sharing one position)
+  // never move. Normals and texcoord0 differences are added to the cost, scaled by attributeWeight.
+  // Collapses stop once the error would exceed targetError, given relative to the mesh's extents.
+  //
+  // Returns the new index count; destination needs room for indexCount indices and may be the
+  // same as indices. resultError receives the worst error, relative to the mesh's extents.
+  size_t simplifyMesh(uint16_t* destination, const uint16_t* indices, size_t indexCount, const bgfx::VertexDecl& decl, const void* vertexData, size_t vertexCount, size_t targetIndexCount, float targetError = 0.01f, float attributeWeight = 0.1f, float* resultError = nullptr);
+
+  // Builds a lod chain sharing meshData's vertex buffer. The simplified index lists are appended
+  // to meshData.indexData after the original, which stays as level 0, so a single index buffer
+  // serves every level. ratios are the target fractions of the original triangle count, largest
+  // first i.e. { 0.5f, 0.25f, 0.125f }. Each level is simplified from the one before it and the
+  // chain stops early once a level cannot get within maxError (relative) or stops shrinking.
+  void generateLods(MeshData& meshData, const float* ratios, size_t ratioCount, GFX_VECTOR<MeshLod>& lods, float maxError = 0.05f, float attributeWeight = 0.1f);
+
+  // Creates the buffers of a LodMesh from meshData and its lods, i.e. from generateLods. At most
+  // kMaxMeshLods levels are kept. The bounding sphere is fitted around the vertex positions.
+  LodMesh createLodMesh(const MeshData& meshData, const MeshLod* lods, size_t lodCount);
+
+}
+
+#endif
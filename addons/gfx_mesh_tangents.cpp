@@ -0,0 +1,468 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_mesh_tangents.h"
+#include "gfx_mesh_optimise.h"
+#include "gfx_task.h"
+
+#include <bx/allocator.h>
+#include <bx/fpumath.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    const size_t kVertexGrain   = 4096;
+    const size_t kTriangleGrain = 4096;
+
+    struct TangentSpace
+    {
+      // input
+      const bgfx::VertexDecl* decl;
+      const uint8_t*          vertexData;
+      const uint16_t*         indices;
+      size_t                  vertexCount;
+      size_t                  triangleCount;
+      uint8_t                 flags;
+
+      // unpacked, per vertex
+      GFX_VECTOR<float>       positions;  // xyz
+      GFX_VECTOR<float>       keys;       // xyz uv, for finding the tangent groups
+      GFX_VECTOR<float>       normals;
+
+      // per triangle
+      GFX_VECTOR<float>       faceNormals;
+      GFX_VECTOR<float>       faceTangents;
+      GFX_VECTOR<float>       faceBitangents;
+      GFX_VECTOR<float>       angles;     // per corner
+
+      // the corners of group g are corners[first[g]] to corners[first[g + 1]].
+      struct Groups
+      {
+        GFX_VECTOR<uint32_t>  remap;      // per vertex
+        GFX_VECTOR<uint32_t>  first;
+        GFX_VECTOR<uint32_t>  corners;
+        GFX_VECTOR<uint32_t>  vertex;     // a vertex of each group
+        size_t                count;
+      };
+
+      Groups                  positionGroups;
+      Groups                  tangentGroups;
+
+      // results
+      GFX_VECTOR<float>       groupNormals;
+      GFX_VECTOR<float>       groupTangents;  // xyzw
+
+      // output
+      const bgfx::VertexDecl* newDecl;
+      uint8_t*                newVertexData;
+    };
+
+    void unpackVertices(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+      bool hasTexCoords = ts.decl->has(bgfx::Attrib::TexCoord0);
+      bool hasNormals = ts.decl->has(bgfx::Attrib::Normal);
+
+      for(size_t i=begin;i < end;i++)
+      {
+        float v[4];
+        bgfx::vertexUnpack(v, bgfx::Attrib::Position, *ts.decl, ts.vertexData, i);
+        memcpy(&ts.positions[i * 3], v, sizeof(float) * 3);
+        memcpy(&ts.keys[i * 5], v, sizeof(float) * 3);
+
+        if (hasTexCoords)
+        {
+          bgfx::vertexUnpack(v, bgfx::Attrib::TexCoord0, *ts.decl, ts.vertexData, i);
+          memcpy(&ts.keys[i * 5 + 3], v, sizeof(float) * 2);
+        }
+
+        if (hasNormals && (ts.flags & kGenerateNormals) == 0)
+        {
+          bgfx::vertexUnpack(v, bgfx::Attrib::Normal, *ts.decl, ts.vertexData, i);
+          bx::vec3Norm(&ts.normals[i * 3], v);
+        }
+      }
+    }
+
+    float angleBetween(const float* a, const float* b)
+    {
+      float la = bx::vec3Length(a), lb = bx::vec3Length(b);
+      if (la == 0.0f || lb == 0.0f)
+        return 0.0f;
+      return bx::facos(bx::fclamp(bx::vec3Dot(a, b) / (la * lb), -1.0f, 1.0f));
+    }
+
+    void buildTriangles(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+
+      for(size_t t=begin;t < end;t++)
+      {
+        const uint16_t* tri = &ts.indices[t * 3];
+        const float* p[3] = { &ts.positions[tri[0] * 3], &ts.positions[tri[1] * 3], &ts.positions[tri[2] * 3] };
+
+        float e1[3], e2[3], n[3];
+        bx::vec3Sub(e1, p[1], p[0]);
+        bx::vec3Sub(e2, p[2], p[0]);
+        bx::vec3Cross(n, e1, e2);
+
+        float* faceNormal = &ts.faceNormals[t * 3];
+        float* faceTangent = &ts.faceTangents[t * 3];
+        float* faceBitangent = &ts.faceBitangents[t * 3];
+        float* angles = &ts.angles[t * 3];
+
+        memset(faceNormal, 0, sizeof(float) * 3);
+        memset(faceTangent, 0, sizeof(float) * 3);
+        memset(faceBitangent, 0, sizeof(float) * 3);
+        memset(angles, 0, sizeof(float) * 3);
+
+        // degenerate triangles don't count towards anything.
+        if (bx::vec3Length(n) == 0.0f)
+          continue;
+
+        bx::vec3Norm(faceNormal, n);
+
+        for(size_t k=0;k < 3;k++)
+        {
+          float a[3], b[3];
+          bx::vec3Sub(a, p[(k + 1) % 3], p[k]);
+          bx::vec3Sub(b, p[(k + 2) % 3], p[k]);
+          angles[k] = angleBetween(a, b);
+        }
+
+        const float* uv0 = &ts.keys[tri[0] * 5 + 3];
+        const float* uv1 = &ts.keys[tri[1] * 5 + 3];
+        const float* uv2 = &ts.keys[tri[2] * 5 + 3];
+
+        float s1 = uv1[0] - uv0[0], t1 = uv1[1] - uv0[1];
+        float s2 = uv2[0] - uv0[0], t2 = uv2[1] - uv0[1];
+        float area = s1 * t2 - s2 * t1;
+
+        if (bx::fabsolute(area) > 1e-20f)
+        {
+          float r = 1.0f / area;
+          for(size_t k=0;k < 3;k++)
+          {
+            faceTangent[k] = (e1[k] * t2 - e2[k] * t1) * r;
+            faceBitangent[k] = (e2[k] * s1 - e1[k] * s2) * r;
+          }
+        }
+      }
+    }
+
+    void buildGroups(TangentSpace::Groups& groups, const bgfx::VertexDecl& keyDecl, const float* keys, const uint16_t* indices, size_t vertexCount, size_t indexCount)
+    {
+      groups.remap.resize(vertexCount);
+      groups.count = generateVertexRemap(&groups.remap[0], keyDecl, keys, vertexCount);
+
+      groups.first.resize(groups.count + 1);
+      groups.vertex.resize(groups.count);
+      memset(&groups.first[0], 0, sizeof(uint32_t) * (groups.count + 1));
+
+      for(size_t i=0;i < vertexCount;i++)
+        groups.vertex[groups.remap[i]] = uint32_t(i);
+
+      for(size_t c=0;c < indexCount;c++)
+        groups.first[groups.remap[indices[c]] + 1]++;
+
+      for(size_t g=0;g < groups.count;g++)
+        groups.first[g + 1] += groups.first[g];
+
+      GFX_VECTOR<uint32_t> fill;
+      fill.resize(groups.count + 1);
+      memcpy(&fill[0], &groups.first[0], sizeof(uint32_t) * (groups.count + 1));
+
+      groups.corners.resize(indexCount + 1);
+      for(size_t c=0;c < indexCount;c++)
+        groups.corners[fill[groups.remap[indices[c]]]++] = uint32_t(c);
+    }
+
+    void gatherNormals(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+      const TangentSpace::Groups& groups = ts.positionGroups;
+
+      for(size_t g=begin;g < end;g++)
+      {
+        float n[3] = { 0.0f, 0.0f, 0.0f };
+
+        for(uint32_t i=groups.first[g];i < groups.first[g + 1];i++)
+        {
+          uint32_t corner = groups.corners[i];
+          float weighted[3];
+          bx::vec3Mul(weighted, &ts.faceNormals[(corner / 3) * 3], ts.angles[corner]);
+          bx::vec3Add(n, n, weighted);
+        }
+
+        float* result = &ts.groupNormals[g * 3];
+        if (bx::vec3Length(n) > 0.0f)
+        {
+          bx::vec3Norm(result, n);
+        }
+        else
+        {
+          result[0] = 0.0f; result[1] = 1.0f; result[2] = 0.0f;
+        }
+      }
+    }
+
+    void scatterNormals(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+
+      for(size_t i=begin;i < end;i++)
+        memcpy(&ts.normals[i * 3], &ts.groupNormals[ts.positionGroups.remap[i] * 3], sizeof(float) * 3);
+    }
+
+    // a - n * dot(n, a), normalised into result; false if nothing is left.
+    bool projectOntoPlane(float* result, const float* a, const float* n)
+    {
+      float d[3];
+      bx::vec3Mul(d, n, bx::vec3Dot(n, a));
+      bx::vec3Sub(d, a, d);
+
+      if (bx::vec3Length(d) <= 1e-20f)
+        return false;
+
+      bx::vec3Norm(result, d);
+      return true;
+    }
+
+    void gatherTangents(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+      const TangentSpace::Groups& groups = ts.tangentGroups;
+
+      for(size_t g=begin;g < end;g++)
+      {
+        const float* n = &ts.normals[groups.vertex[g] * 3];
+        float t[3] = { 0.0f, 0.0f, 0.0f };
+        float b[3] = { 0.0f, 0.0f, 0.0f };
+
+        for(uint32_t i=groups.first[g];i < groups.first[g + 1];i++)
+        {
+          uint32_t corner = groups.corners[i];
+          size_t triangle = corner / 3;
+          float projected[3];
+
+          if (projectOntoPlane(projected, &ts.faceTangents[triangle * 3], n))
+          {
+            bx::vec3Mul(projected, projected, ts.angles[corner]);
+            bx::vec3Add(t, t, projected);
+          }
+
+          if (projectOntoPlane(projected, &ts.faceBitangents[triangle * 3], n))
+          {
+            bx::vec3Mul(projected, projected, ts.angles[corner]);
+            bx::vec3Add(b, b, projected);
+          }
+        }
+
+        float* result = &ts.groupTangents[g * 4];
+
+        if (projectOntoPlane(result, t, n) == false)
+        {
+          // no usable uvs; any tangent will do, as long as it's perpendicular.
+          float axis[3] = { 1.0f, 0.0f, 0.0f };
+          if (bx::fabsolute(n[0]) > 0.9f)
+          {
+            axis[0] = 0.0f;
+            axis[1] = 1.0f;
+          }
+          projectOntoPlane(result, axis, n);
+        }
+
+        float c[3];
+        bx::vec3Cross(c, n, result);
+        result[3] = bx::vec3Dot(c, b) < 0.0f ? -1.0f : 1.0f;
+      }
+    }
+
+    void packVertices(size_t begin, size_t end, void* userData)
+    {
+      TangentSpace& ts = *(TangentSpace*) userData;
+      const bgfx::VertexDecl& decl = *ts.newDecl;
+      uint8_t* vertexData = ts.newVertexData;
+
+      if (vertexData != ts.vertexData)
+        bgfx::vertexConvert(decl, vertexData + begin * decl.getStride(), *ts.decl, ts.vertexData + begin * ts.decl->getStride(), uint32_t(end - begin));
+
+      for(size_t i=begin;i < end;i++)
+      {
+        const float* n = &ts.normals[i * 3];
+
+        if (ts.flags & kGenerateNormals)
+        {
+          float v[4] = { n[0], n[1], n[2], 0.0f };
+          bgfx::vertexPack(v, true, bgfx::Attrib::Normal, decl, vertexData, i);
+        }
+
+        if (ts.flags & (kGenerateTangents | kGenerateBitangents))
+        {
+          const float* t = &ts.groupTangents[ts.tangentGroups.remap[i] * 4];
+
+          if (ts.flags & kGenerateTangents)
+            bgfx::vertexPack(t, true, bgfx::Attrib::Tangent, decl, vertexData, i);
+
+          if (ts.flags & kGenerateBitangents)
+          {
+            float b[4];
+            bx::vec3Cross(b, n, t);
+            bx::vec3Mul(b, b, t[3]);
+            b[3] = 0.0f;
+            bgfx::vertexPack(b, true, bgfx::Attrib::Bitangent, decl, vertexData, i);
+          }
+        }
+      }
+    }
+  }
+
+  bool generateTangentSpace(MeshData& meshData, uint8_t flags)
+  {
+    const bgfx::VertexDecl& decl = meshData.decl;
+    size_t vertexCount = getVertexCount(meshData);
+    size_t indexCount = getIndexCount(meshData);
+
+    if (vertexCount == 0 || indexCount < 3 || decl.has(bgfx::Attrib::Position) == false)
+      return false;
+
+    bool needTangents = (flags & (kGenerateTangents | kGenerateBitangents)) != 0;
+
+    if (needTangents && decl.has(bgfx::Attrib::TexCoord0) == false)
+      return false;
+
+    // tangents need normals; make them if there are none to use.
+    if (needTangents && decl.has(bgfx::Attrib::Normal) == false)
+      flags |= kGenerateNormals;
+
+    TangentSpace ts;
+    ts.decl = &decl;
+    ts.vertexData = meshData.vertexData.data;
+    ts.indices = (const uint16_t*) meshData.indexData.data;
+    ts.vertexCount = vertexCount;
+    ts.triangleCount = indexCount / 3;
+    ts.flags = flags;
+
+    ts.positions.resize(vertexCount * 3);
+    ts.keys.resize(vertexCount * 5);
+    ts.normals.resize(vertexCount * 3);
+    memset(&ts.keys[0], 0, sizeof(float) * vertexCount * 5);
+
+    parallelFor(vertexCount, kVertexGrain, unpackVertices, &ts);
+
+    ts.faceNormals.resize(ts.triangleCount * 3);
+    ts.faceTangents.resize(ts.triangleCount * 3);
+    ts.faceBitangents.resize(ts.triangleCount * 3);
+    ts.angles.resize(ts.triangleCount * 3);
+
+    parallelFor(ts.triangleCount, kTriangleGrain, buildTriangles, &ts);
+
+    size_t cornerCount = ts.triangleCount * 3;
+
+    if (flags & kGenerateNormals)
+    {
+      bgfx::VertexDecl positionDecl;
+      positionDecl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).end();
+
+      buildGroups(ts.positionGroups, positionDecl, &ts.positions[0], ts.indices, vertexCount, cornerCount);
+
+      ts.groupNormals.resize(ts.positionGroups.count * 3);
+      parallelFor(ts.positionGroups.count, kVertexGrain, gatherNormals, &ts);
+      parallelFor(vertexCount, kVertexGrain, scatterNormals, &ts);
+    }
+
+    if (needTangents)
+    {
+      bgfx::VertexDecl keyDecl;
+      keyDecl.begin()
+        .add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+        .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+        .end();
+
+      buildGroups(ts.tangentGroups, keyDecl, &ts.keys[0], ts.indices, vertexCount, cornerCount);
+
+      ts.groupTangents.resize(ts.tangentGroups.count * 4);
+      parallelFor(ts.tangentGroups.count, kVertexGrain, gatherTangents, &ts);
+    }
+
+    // add what the decl is missing, after what it already has.
+    bgfx::Attrib::Enum added[3];
+    size_t addedCount = 0;
+
+    if ((flags & kGenerateNormals) && decl.has(bgfx::Attrib::Normal) == false)
+      added[addedCount++] = bgfx::Attrib::Normal;
+    if ((flags & kGenerateTangents) && decl.has(bgfx::Attrib::Tangent) == false)
+      added[addedCount++] = bgfx::Attrib::Tangent;
+    if ((flags & kGenerateBitangents) && decl.has(bgfx::Attrib::Bitangent) == false)
+      added[addedCount++] = bgfx::Attrib::Bitangent;
+
+    bgfx::VertexDecl newDecl = decl;
+    bx::AllocatorI* allocator = meshData.allocator;
+    uint8_t* vertexData = meshData.vertexData.data;
+
+    if (addedCount > 0)
+    {
+      newDecl.begin();
+
+      for(size_t a=0;a < bgfx::Attrib::Count;a++)
+      {
+        bgfx::Attrib::Enum attrib = static_cast<bgfx::Attrib::Enum>(a);
+
+        if (decl.has(attrib) == false)
+          continue;
+
+        uint8_t num;
+        bgfx::AttribType::Enum type;
+        bool normalised, asInt;
+        decl.decode(attrib, num, type, normalised, asInt);
+        newDecl.add(attrib, num, type, normalised, asInt);
+      }
+
+      for(size_t i=0;i < addedCount;i++)
+        newDecl.add(added[i], added[i] == bgfx::Attrib::Tangent ? 4 : 3, bgfx::AttribType::Float);
+
+      newDecl.end();
+
+      vertexData = (uint8_t*) BX_ALLOC(allocator, vertexCount * newDecl.getStride());
+    }
+
+    ts.newDecl = &newDecl;
+    ts.newVertexData = vertexData;
+
+    parallelFor(vertexCount, kVertexGrain, packVertices, &ts);
+
+    if (vertexData != meshData.vertexData.data)
+    {
+      BX_FREE(allocator, meshData.vertexData.data);
+
+      meshData.decl = newDecl;
+      meshData.vertexData.data = vertexData;
+      meshData.vertexData.size = uint32_t(vertexCount * newDecl.getStride());
+    }
+
+    return true;
+  }
+
+}
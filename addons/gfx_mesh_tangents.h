@@ -0,0 +1,55 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESH_TANGENTS_H
+#define GFX_MESH_TANGENTS_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  static const uint8_t kGenerateNormals    = 1;
+  static const uint8_t kGenerateTangents   = 2;  // xyz, and the handedness of the bitangent in w
+  static const uint8_t kGenerateBitangents = 4;
+  static const uint8_t kGenerateTangentSpace = kGenerateNormals | kGenerateTangents;
+
+  // Generates smooth normals and/or tangents for an indexed triangle list.
+  //
+  // Normals are the angle weighted average of the faces around each position, so they are smooth
+  // across uv seams. Tangents follow MikkTSpace's conventions; per corner tangents from the uv
+  // derivatives, projected onto the normal, angle weighted and averaged over the corners sharing
+  // a position and uv, with w = +/-1 such that bitangent = w * cross(normal, tangent).
+  // Vertices are not split where the handedness flips, as MikkTSpace would.
+  //
+  // Attributes which meshData's decl doesn't have are added as floats, existing ones are written
+  // in their own format. Work is spread over the gfx_task workers; each pass gathers per vertex
+  // rather than scattering per triangle, so no two threads ever write the same vertex.
+  //
+  // Returns false if meshData has no index buffer, or tangents were asked for without texcoord0.
+  bool generateTangentSpace(MeshData& meshData, uint8_t flags = kGenerateTangentSpace);
+
+}
+
+#endif
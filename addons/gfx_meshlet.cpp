@@ -0,0 +1,280 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_meshlet.h"
+
+#include <bx/fpumath.h>
+#include <float.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    void finishMeshlet(Meshlet& meshlet, const uint16_t* indices, const GFX_VECTOR<float>& positions)
+    {
+      float minimum[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+      float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      float axis[3] = { 0, 0, 0 };
+
+      const uint16_t* tris = &indices[meshlet.firstIndex];
+      size_t triangleCount = meshlet.indexCount / 3;
+
+      GFX_VECTOR<float> normals;
+      normals.resize(triangleCount * 3);
+
+      for(size_t i=0;i < triangleCount;i++)
+      {
+        const float* p0 = &positions[tris[i * 3 + 0] * 3];
+        const float* p1 = &positions[tris[i * 3 + 1] * 3];
+        const float* p2 = &positions[tris[i * 3 + 2] * 3];
+
+        bx::vec3Min(minimum, minimum, p0); bx::vec3Max(maximum, maximum, p0);
+        bx::vec3Min(minimum, minimum, p1); bx::vec3Max(maximum, maximum, p1);
+        bx::vec3Min(minimum, minimum, p2); bx::vec3Max(maximum, maximum, p2);
+
+        float e0[3], e1[3], n[3];
+        bx::vec3Sub(e0, p1, p0);
+        bx::vec3Sub(e1, p2, p0);
+        bx::vec3Cross(n, e0, e1);
+
+        float length = bx::vec3Length(n);
+        if (length > 0.0f)
+          bx::vec3Mul(n, n, 1.0f / length);
+
+        memcpy(&normals[i * 3], n, sizeof(n));
+        bx::vec3Add(axis, axis, n);
+      }
+
+      bx::vec3Add(meshlet.centre, minimum, maximum);
+      bx::vec3Mul(meshlet.centre, meshlet.centre, 0.5f);
+
+      meshlet.radius = 0.0f;
+      for(size_t i=0;i < triangleCount * 3;i++)
+      {
+        float d[3];
+        bx::vec3Sub(d, &positions[tris[i] * 3], meshlet.centre);
+        meshlet.radius = bx::fmax(meshlet.radius, bx::vec3Length(d));
+      }
+
+      // normal cone; the widest angle between the average normal and any triangle's.
+      float axisLength = bx::vec3Length(axis);
+      float minDot = -1.0f;
+
+      if (axisLength > 0.0f)
+      {
+        bx::vec3Mul(axis, axis, 1.0f / axisLength);
+
+        minDot = 1.0f;
+        for(size_t i=0;i < triangleCount;i++)
+          minDot = bx::fmin(minDot, bx::vec3Dot(axis, &normals[i * 3]));
+      }
+
+      memcpy(meshlet.coneAxis, axis, sizeof(axis));
+
+      // a cone spreading past ~84 degrees is visible from nearly everywhere in front of it.
+      meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : bx::fsqrt(1.0f - minDot * minDot);
+    }
+  }
+
+  void buildMeshlets(const MeshData& meshData, GFX_VECTOR<Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles)
+  {
+    meshlets.clear();
+
+    size_t vertexCount = getVertexCount(meshData);
+    size_t indexCount = getIndexCount(meshData);
+    const uint16_t* indices = (const uint16_t*) meshData.indexData.data;
+
+    if (indexCount == 0 || maxVertices < 3 || maxTriangles == 0)
+      return;
+
+    GFX_VECTOR<float> positions;
+    positions.resize(vertexCount * 3);
+
+    for(size_t i=0;i < vertexCount;i++)
+    {
+      float v[4];
+      bgfx::vertexUnpack(v, bgfx::Attrib::Position, meshData.decl, meshData.vertexData.data, i);
+      memcpy(&positions[i * 3], v, sizeof(float) * 3);
+    }
+
+    // stamp[v] is the meshlet that last used v, so membership needs no clearing between meshlets.
+    GFX_VECTOR<uint32_t> stamp;
+    stamp.resize(vertexCount);
+    memset(&stamp[0], 0xff, sizeof(uint32_t) * vertexCount);
+
+    Meshlet meshlet;
+    memset(&meshlet, 0, sizeof(Meshlet));
+    uint32_t meshletVertices = 0;
+
+    for(size_t i=0;i + 2 < indexCount;i += 3)
+    {
+      uint32_t id = uint32_t(meshlets.size());
+      uint32_t added = 0;
+      for(size_t k=0;k < 3;k++)
+      {
+        if (stamp[indices[i + k]] != id)
+          added++;
+      }
+
+      if (meshlet.indexCount > 0 && (meshletVertices + added > maxVertices || meshlet.indexCount / 3 + 1 > maxTriangles))
+      {
+        finishMeshlet(meshlet, indices, positions);
+        meshlets.push_back(meshlet);
+
+        memset(&meshlet, 0, sizeof(Meshlet));
+        meshlet.firstIndex = uint32_t(i);
+        meshletVertices = 0;
+        id++;
+      }
+
+      for(size_t k=0;k < 3;k++)
+      {
+        if (stamp[indices[i + k]] != id)
+        {
+          stamp[indices[i + k]] = id;
+          meshletVertices++;
+        }
+      }
+
+      meshlet.indexCount += 3;
+    }
+
+    finishMeshlet(meshlet, indices, positions);
+    meshlets.push_back(meshlet);
+  }
+
+  void cullMeshlets(GFX_VECTOR<IndexRange>& ranges, const Meshlet* meshlets, size_t meshletCount, const Matrix& model, const Matrix& view, const Matrix& projection)
+  {
+    size_t first = ranges.size();
+    ranges.resize(first + meshletCount);
+
+    size_t count = meshletCount > 0 ? cullMeshlets(&ranges[first], meshlets, meshletCount, model, view, projection) : 0;
+    ranges.resize(first + count);
+  }
+
+  size_t cullMeshlets(IndexRange* ranges, const Meshlet* meshlets, size_t meshletCount, const Matrix& model, const Matrix& view, const Matrix& projection)
+  {
+    size_t count = 0;
+
+    float modelView[16], modelViewProj[16], inverse[16];
+    bx::mtxMul(modelView, model.ptr(), view.ptr());
+    bx::mtxMul(modelViewProj, modelView, projection.ptr());
+    bx::mtxInverse(inverse, modelView);
+
+    // the camera, in model space.
+    const float* eye = &inverse[12];
+
+    // frustum planes in model space, from the columns of the (row vector) clip matrix. Near is
+    // taken as z >= -w, which holds for both the 0..1 and -1..1 depth ranges.
+    float planes[6][4];
+    for(size_t i=0;i < 4;i++)
+    {
+      float c0 = modelViewProj[i * 4 + 0];
+      float c1 = modelViewProj[i * 4 + 1];
+      float c2 = modelViewProj[i * 4 + 2];
+      float c3 = modelViewProj[i * 4 + 3];
+
+      planes[0][i] = c3 + c0;
+      planes[1][i] = c3 - c0;
+      planes[2][i] = c3 + c1;
+      planes[3][i] = c3 - c1;
+      planes[4][i] = c3 + c2;
+      planes[5][i] = c3 - c2;
+    }
+
+    for(size_t p=0;p < 6;p++)
+    {
+      float length = bx::vec3Length(planes[p]);
+      if (length > 0.0f)
+      {
+        for(size_t i=0;i < 4;i++)
+          planes[p][i] /= length;
+      }
+    }
+
+    for(size_t m=0;m < meshletCount;m++)
+    {
+      const Meshlet& meshlet = meshlets[m];
+
+      bool visible = true;
+      for(size_t p=0;p < 6 && visible;p++)
+      {
+        if (bx::vec3Dot(planes[p], meshlet.centre) + planes[p][3] < -meshlet.radius)
+          visible = false;
+      }
+
+      if (visible && meshlet.coneCutoff < 1.0f)
+      {
+        float d[3];
+        bx::vec3Sub(d, meshlet.centre, eye);
+
+        if (bx::vec3Dot(d, meshlet.coneAxis) >= meshlet.coneCutoff * bx::vec3Length(d) + meshlet.radius)
+          visible = false;
+      }
+
+      if (visible == false)
+        continue;
+
+      if (count > 0 && ranges[count - 1].firstIndex + ranges[count - 1].indexCount == meshlet.firstIndex)
+      {
+        ranges[count - 1].indexCount += meshlet.indexCount;
+      }
+      else
+      {
+        IndexRange range = { meshlet.firstIndex, meshlet.indexCount };
+        ranges[count++] = range;
+      }
+    }
+
+    return count;
+  }
+
+  MeshletMesh createMeshletMesh(const MeshData& meshData, const GFX_VECTOR<Meshlet>& meshlets)
+  {
+    MeshletMesh mesh;
+    mesh.vertexBuffer = bgfx::createVertexBuffer(bgfx::copy(meshData.vertexData.data, meshData.vertexData.size), meshData.decl);
+    mesh.indexBuffer = bgfx::createIndexBuffer(bgfx::copy(meshData.indexData.data, meshData.indexData.size));
+    mesh.meshlets = meshlets;
+    return mesh;
+  }
+
+  void draw(const MeshletMesh& mesh)
+  {
+    if (mesh.meshlets.empty())
+      return;
+
+    Matrix model = getModelMatrix();
+
+    IndexRange* ranges = frameAlloc<IndexRange>(mesh.meshlets.size());
+    size_t count = cullMeshlets(ranges, &mesh.meshlets[0], mesh.meshlets.size(), model, getViewMatrix(), getProjectionMatrix());
+
+    for(size_t i=0;i < count;i++)
+    {
+      // bgfx forgets the transform after each submit, so every range sets it again.
+      setModelMatrix(model);
+      draw(mesh.vertexBuffer, mesh.indexBuffer, ranges[i].firstIndex, ranges[i].indexCount);
+    }
+  }
+
+}
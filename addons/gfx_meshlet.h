@@ -0,0 +1,81 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_MESHLET_H
+#define GFX_MESHLET_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  static const uint32_t kMeshletMaxVertices  = 64;
+  static const uint32_t kMeshletMaxTriangles = 124;
+
+  // A run of triangles in a mesh's index buffer, with the data needed to cull it on its own.
+  struct Meshlet
+  {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    centre[3];    // bounding sphere, in model space
+    float    radius;
+    float    coneAxis[3];  // average facing of the triangles
+    float    coneCutoff;   // sin of the cone's spread; 1 when the meshlet can't be back face culled
+  };
+
+  struct IndexRange
+  {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+  };
+
+  struct MeshletMesh
+  {
+    bgfx::VertexBufferHandle vertexBuffer;
+    bgfx::IndexBufferHandle  indexBuffer;
+    GFX_VECTOR<Meshlet>      meshlets;
+  };
+
+  // Splits meshData's triangles, in index buffer order, into meshlets of at most maxVertices
+  // unique vertices and maxTriangles triangles. Run the vertex cache optimiser first; triangles
+  // that are close in the index buffer make for tight meshlets. The index buffer is not changed.
+  void buildMeshlets(const MeshData& meshData, GFX_VECTOR<Meshlet>& meshlets, uint32_t maxVertices = kMeshletMaxVertices, uint32_t maxTriangles = kMeshletMaxTriangles);
+
+  // Appends the index ranges of the meshlets that are inside the view frustum and not facing away
+  // from the camera. Neighbouring visible meshlets are merged into one range.
+  void cullMeshlets(GFX_VECTOR<IndexRange>& ranges, const Meshlet* meshlets, size_t meshletCount, const Matrix& model, const Matrix& view, const Matrix& projection);
+
+  // As above, into ranges, which must have room for meshletCount of them. Returns the number written.
+  size_t cullMeshlets(IndexRange* ranges, const Meshlet* meshlets, size_t meshletCount, const Matrix& model, const Matrix& view, const Matrix& projection);
+
+  //
+  MeshletMesh createMeshletMesh(const MeshData& meshData, const GFX_VECTOR<Meshlet>& meshlets);
+
+  // Culls the meshlets with the current matrices, and draws what is left. The ranges are kept in
+  // the calling thread's frame arena.
+  void draw(const MeshletMesh& mesh);
+
+}
+
+#endif
@@ -0,0 +1,517 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_preload.h"
+#include "gfx_mapped_file.h"
+#include "gfx_program.h"
+#include "gfx_task.h"
+
+#include <bx/readerwriter.h>
+#include <bx/timer.h>
+#include <stdio.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    enum AssetStage
+    {
+      kQueued,
+      kReading,   // on a worker
+      kRead,      // waiting for its dependencies, or for update
+      kDone
+    };
+
+    double toSeconds(int64_t ticks)
+    {
+      return double(ticks) / double(bx::getHPFrequency());
+    }
+
+    bool isSpace(char c)
+    {
+      return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void copyString(char* dst, size_t dstSize, const char* src)
+    {
+      strncpy(dst, src, dstSize - 1);
+      dst[dstSize - 1] = '\0';
+    }
+  }
+
+  struct Preloader::Asset
+  {
+    Asset(bx::AllocatorI* _allocator)
+      : isProgram(false),
+        stage(kQueued),
+        dependencyCount(0),
+        meshData(_allocator)
+    {
+      memset(&timing, 0, sizeof(timing));
+      mesh.vertexBuffer.idx = bgfx::invalidHandle;
+      mesh.indexBuffer.idx = bgfx::invalidHandle;
+      program.idx = bgfx::invalidHandle;
+      shaderData[0] = shaderData[1] = nullptr;
+      shaderSize[0] = shaderSize[1] = 0;
+    }
+
+    Preloader*          preloader;
+    bool                isProgram;
+    AssetStage          stage;
+    char                name[kMaxPreloadNameLength + 1];
+    char                names[2][512];   // the shader names of a program
+    char                paths[2][512];   // what is read; the mesh, or the program's shaders
+    uint32_t            dependencies[kMaxPreloadDependencies];
+    uint32_t            dependencyCount;
+    PreloadTiming       timing;
+
+    MeshData            meshData;
+    uint8_t*            shaderData[2];
+    uint32_t            shaderSize[2];
+
+    Mesh                mesh;
+    bgfx::ProgramHandle program;
+  };
+
+  Preloader::Preloader()
+    : startTime(0),
+      totalSeconds(0.0),
+      reading(0),
+      uploaded(0),
+      started(false)
+  {
+  }
+
+  Preloader::~Preloader()
+  {
+    // the workers still reading hold their assets.
+    for(;;)
+    {
+      {
+        bx::MutexScope lock(mutex);
+        if (reading == 0)
+          break;
+      }
+
+      readDone.wait();
+    }
+
+    for(size_t i=0;i < assets.size();i++)
+    {
+      for(size_t j=0;j < 2;j++)
+        BX_FREE(&allocator, assets[i]->shaderData[j]);
+
+      BX_DELETE(&allocator, assets[i]);
+    }
+  }
+
+  uint32_t Preloader::addAsset(const char* name, bool isProgram, const char* path0, const char* path1)
+  {
+    if (started || strlen(name) > kMaxPreloadNameLength || find(name) != kInvalidPreloadAsset)
+      return kInvalidPreloadAsset;
+
+    // workers fill it, so it can't use the default allocator, which needn't be thread safe.
+    Asset* asset = BX_NEW(&allocator, Asset)(&allocator);
+    asset->preloader = this;
+    asset->isProgram = isProgram;
+    copyString(asset->name, sizeof(asset->name), name);
+
+    if (isProgram)
+    {
+      copyString(asset->names[0], sizeof(asset->names[0]), path0);
+      copyString(asset->names[1], sizeof(asset->names[1]), path1);
+
+      // the paths depend on the renderer, so they are worked out by start.
+      asset->paths[0][0] = asset->paths[1][0] = '\0';
+    }
+    else
+    {
+      asset->names[0][0] = asset->names[1][0] = '\0';
+      copyString(asset->paths[0], sizeof(asset->paths[0]), path0);
+      asset->paths[1][0] = '\0';
+    }
+
+    assets.push_back(asset);
+    return uint32_t(assets.size() - 1);
+  }
+
+  uint32_t Preloader::addMesh(const char* name, const char* path)
+  {
+    return addAsset(name, false, path, "");
+  }
+
+  uint32_t Preloader::addProgram(const char* name, const char* vertexShaderName, const char* fragmentShaderName)
+  {
+    return addAsset(name, true, vertexShaderName, fragmentShaderName);
+  }
+
+  bool Preloader::addDependency(uint32_t asset, uint32_t dependsOn)
+  {
+    if (started || asset >= assets.size() || dependsOn >= asset)
+      return false;
+
+    Asset& a = *assets[asset];
+    for(uint32_t i=0;i < a.dependencyCount;i++)
+    {
+      if (a.dependencies[i] == dependsOn)
+        return true;
+    }
+
+    if (a.dependencyCount == kMaxPreloadDependencies)
+      return false;
+
+    a.dependencies[a.dependencyCount++] = dependsOn;
+    return true;
+  }
+
+  bool Preloader::loadManifest(const char* path, bx::FileReaderI* reader)
+  {
+    bool ownReader = false;
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(&allocator, MappedFileReader);
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(&allocator, bx::CrtFileReader);
+      ownReader = true;
+    }
+#endif
+
+    GFX_VECTOR<char> text;
+    bool ok = bx::open(reader, path) == 0;
+
+    if (ok)
+    {
+      text.resize(size_t(bx::getSize(reader)) + 1);
+      bx::read(reader, &text[0], int32_t(text.size() - 1));
+      bx::close(reader);
+      text.back() = '\0';
+    }
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownReader)
+    {
+      BX_DELETE(&allocator, reader);
+    }
+#endif
+
+    char* line = ok ? &text[0] : nullptr;
+
+    while (line != nullptr && ok)
+    {
+      char* next = strchr(line, '\n');
+      if (next != nullptr)
+        *next++ = '\0';
+
+      char* comment = strchr(line, '#');
+      if (comment != nullptr)
+        *comment = '\0';
+
+      // kind, name, one or two paths, then ':' and the dependencies.
+      const char* tokens[4 + kMaxPreloadDependencies];
+      uint32_t tokenCount = 0;
+      uint32_t colon = 0;
+
+      for(char* c = line;*c != '\0' && ok;)
+      {
+        if (isSpace(*c))
+        {
+          *c++ = '\0';
+          continue;
+        }
+
+        if (c[0] == ':' && (c[1] == '\0' || isSpace(c[1])) && colon == 0)
+          colon = tokenCount;
+        else if (tokenCount < BX_COUNTOF(tokens))
+          tokens[tokenCount++] = c;
+        else
+          ok = false;
+
+        while (*c != '\0' && isSpace(*c) == false)
+          c++;
+      }
+
+      if (colon == 0)
+        colon = tokenCount;
+
+      if (ok && tokenCount > 0)
+      {
+        uint32_t asset = kInvalidPreloadAsset;
+
+        if (strcmp(tokens[0], "mesh") == 0 && colon == 3)
+          asset = addMesh(tokens[1], tokens[2]);
+        else if (strcmp(tokens[0], "program") == 0 && colon == 4)
+          asset = addProgram(tokens[1], tokens[2], tokens[3]);
+
+        ok = asset != kInvalidPreloadAsset;
+
+        for(uint32_t i=colon;i < tokenCount && ok;i++)
+          ok = addDependency(asset, find(tokens[i]));
+      }
+
+      line = next;
+    }
+
+    return ok;
+  }
+
+  void Preloader::readAsset(void* userData)
+  {
+    Asset& asset = *(Asset*) userData;
+    Preloader& preloader = *asset.preloader;
+
+    int64_t readStart = bx::getHPCounter();
+    bool failed;
+
+    if (asset.isProgram)
+    {
+#if GFX_CONFIG_MAPPED_FILE_READER
+      MappedFileReader reader;
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+      bx::CrtFileReader reader;
+#endif
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+      for(size_t i=0;i < 2;i++)
+      {
+        if (bx::open(&reader, asset.paths[i]) == 0)
+        {
+          asset.shaderSize[i] = (uint32_t) bx::getSize(&reader);
+          asset.shaderData[i] = (uint8_t*) BX_ALLOC(&preloader.allocator, asset.shaderSize[i] + 1);
+          bx::read(&reader, asset.shaderData[i], asset.shaderSize[i]);
+          bx::close(&reader);
+        }
+      }
+#endif
+
+      failed = asset.shaderData[0] == nullptr || asset.shaderData[1] == nullptr;
+    }
+    else
+    {
+      loadTextMesh(asset.paths[0], asset.meshData);
+      failed = asset.meshData.vertexData.size == 0;
+    }
+
+    {
+      bx::MutexScope lock(preloader.mutex);
+      asset.timing.readSeconds = toSeconds(bx::getHPCounter() - readStart);
+      asset.timing.failed = failed;
+      asset.stage = kRead;
+      preloader.reading--;
+
+      // posted with the mutex held, so the destructor can't see the last read finish and free
+      // the semaphore before this returns.
+      preloader.readDone.post();
+    }
+  }
+
+  void Preloader::start()
+  {
+    if (started)
+      return;
+
+    {
+      bx::MutexScope lock(mutex);
+      started = true;
+      startTime = bx::getHPCounter();
+      reading = uint32_t(assets.size());
+
+      for(size_t i=0;i < assets.size();i++)
+      {
+        Asset& asset = *assets[i];
+        asset.stage = kReading;
+
+        if (asset.isProgram)
+        {
+          getShaderPath(asset.paths[0], asset.names[0]);
+          getShaderPath(asset.paths[1], asset.names[1]);
+        }
+      }
+    }
+
+    // with no workers, every asset is read here.
+    for(size_t i=0;i < assets.size();i++)
+      runTask(readAsset, assets[i]);
+  }
+
+  bool Preloader::update()
+  {
+    if (started == false)
+      return assets.empty();
+
+    // dependencies come before the assets that need them, so one pass in order uploads
+    // everything that is ready, including chains that became ready during it.
+    for(size_t i=0;i < assets.size();i++)
+    {
+      Asset& asset = *assets[i];
+
+      // workers write the stages, so they are read under the lock.
+      bool ready;
+      {
+        bx::MutexScope lock(mutex);
+
+        ready = asset.stage == kRead;
+        for(uint32_t j=0;j < asset.dependencyCount && ready;j++)
+          ready = assets[asset.dependencies[j]]->stage == kDone;
+      }
+
+      if (ready == false)
+        continue;
+
+      int64_t uploadStart = bx::getHPCounter();
+
+      // an asset goes ahead when a dependency failed; whatever uses it finds out from getTiming.
+      if (asset.timing.failed == false)
+      {
+        if (asset.isProgram)
+        {
+          PreloadedShaderReader reader(asset.paths, asset.shaderData, asset.shaderSize);
+          asset.program = loadProgram(asset.names[0], asset.names[1], &reader);
+          asset.timing.failed = asset.program.idx == bgfx::invalidHandle;
+        }
+        else
+        {
+          // copied; the bytes come from this preloader's allocator, which may be gone by the
+          // time bgfx has finished with them.
+          asset.mesh = createMesh(asset.meshData);
+        }
+      }
+
+      for(size_t j=0;j < 2;j++)
+      {
+        BX_FREE(&allocator, asset.shaderData[j]);
+        asset.shaderData[j] = nullptr;
+      }
+
+      asset.meshData = MeshData(&allocator);
+
+      int64_t now = bx::getHPCounter();
+      asset.timing.uploadSeconds = toSeconds(now - uploadStart);
+      asset.timing.readySeconds = toSeconds(now - startTime);
+
+      {
+        bx::MutexScope lock(mutex);
+        asset.stage = kDone;
+      }
+
+      uploaded++;
+      totalSeconds = asset.timing.readySeconds;
+    }
+
+    return uploaded == assets.size();
+  }
+
+  void Preloader::run()
+  {
+    start();
+
+    // when nothing could be uploaded, something is still being read and will post.
+    while (update() == false)
+      readDone.wait();
+  }
+
+  uint32_t Preloader::find(const char* name) const
+  {
+    for(size_t i=0;i < assets.size();i++)
+    {
+      if (strcmp(assets[i]->name, name) == 0)
+        return uint32_t(i);
+    }
+
+    return kInvalidPreloadAsset;
+  }
+
+  bool Preloader::getMesh(uint32_t asset, Mesh& mesh) const
+  {
+    if (asset >= assets.size() || assets[asset]->stage != kDone || assets[asset]->timing.failed || assets[asset]->isProgram)
+      return false;
+
+    mesh = assets[asset]->mesh;
+    return true;
+  }
+
+  bool Preloader::getProgram(uint32_t asset, bgfx::ProgramHandle& program) const
+  {
+    if (asset >= assets.size() || assets[asset]->stage != kDone || assets[asset]->timing.failed || assets[asset]->isProgram == false)
+      return false;
+
+    program = assets[asset]->program;
+    return true;
+  }
+
+  const PreloadTiming& Preloader::getTiming(uint32_t asset) const
+  {
+    static const PreloadTiming kNoTiming = { 0.0, 0.0, 0.0, true };
+    return asset < assets.size() ? assets[asset]->timing : kNoTiming;
+  }
+
+  double Preloader::getCriticalPathSeconds() const
+  {
+    // every read starts at once, so an asset could be uploaded once it and its dependencies
+    // were; dependencies come first, so each one's time is known before it is needed.
+    GFX_VECTOR<double> ready;
+    ready.resize(assets.size());
+
+    double longest = 0.0;
+    for(size_t i=0;i < assets.size();i++)
+    {
+      const Asset& asset = *assets[i];
+
+      double start = asset.timing.readSeconds;
+      for(uint32_t j=0;j < asset.dependencyCount;j++)
+        start = ready[asset.dependencies[j]] > start ? ready[asset.dependencies[j]] : start;
+
+      ready[i] = start + asset.timing.uploadSeconds;
+      longest = ready[i] > longest ? ready[i] : longest;
+    }
+
+    return longest;
+  }
+
+  void Preloader::printReport() const
+  {
+    double serial = 0.0;
+
+    printf("%-24s %-8s %10s %10s %10s\n", "asset", "kind", "read ms", "upload ms", "ready ms");
+
+    for(size_t i=0;i < assets.size();i++)
+    {
+      const Asset& asset = *assets[i];
+      serial += asset.timing.readSeconds + asset.timing.uploadSeconds;
+
+      printf("%-24s %-8s %10.2f %10.2f %10.2f%s\n", asset.name, asset.isProgram ? "program" : "mesh",
+        asset.timing.readSeconds * 1000.0, asset.timing.uploadSeconds * 1000.0, asset.timing.readySeconds * 1000.0,
+        asset.timing.failed ? " failed" : "");
+    }
+
+    printf("%u assets; %.2f ms, critical path %.2f ms, %.2f ms one after the other\n", uint32_t(assets.size()),
+      totalSeconds * 1000.0, getCriticalPathSeconds() * 1000.0, serial * 1000.0);
+  }
+
+}
@@ -0,0 +1,142 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_PRELOAD_H
+#define GFX_PRELOAD_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+#include <bx/allocator.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
+
+namespace GFX_NS
+{
+
+  // Loads a set of meshes and programs at startup. Every file is read and parsed at once on the
+  // gfx_task workers; each asset is then uploaded to bgfx as soon as it has been read and the
+  // assets it depends on have been uploaded, so startup takes about as long as the slowest
+  // chain of assets rather than all of them one after the other.
+  //
+  // A manifest has one asset a line; its kind, its name, what to load and, after a ':', the
+  // names of assets above it that must be uploaded first. '#' starts a comment.
+  //
+  //   program mesh     vs_mesh fs_mesh
+  //   mesh    rock     meshes/rock.txt
+  //   mesh    rockLod  meshes/rock_lod.txt : rock mesh
+  //
+  // What is loaded belongs to the caller once it is uploaded; programs come from loadProgram, so
+  // they are shared with the rest of the program cache and given back with releaseProgram.
+
+  static const uint32_t kInvalidPreloadAsset     = UINT32_MAX;
+  static const uint32_t kMaxPreloadDependencies  = 8;
+  static const uint32_t kMaxPreloadNameLength    = 63;
+
+  struct PreloadTiming
+  {
+    double readSeconds;    // reading and parsing, on a worker
+    double uploadSeconds;  // creating the bgfx resources
+    double readySeconds;   // from start until it was uploaded
+    bool   failed;
+  };
+
+  class Preloader
+  {
+  public:
+
+    Preloader();
+    ~Preloader();
+
+    // Returns the asset's index, or kInvalidPreloadAsset once started or if the name is taken.
+    uint32_t addMesh(const char* name, const char* path);
+
+    // The shader names are as loadProgram takes them; the files are read on a worker and then
+    // given to loadProgram.
+    uint32_t addProgram(const char* name, const char* vertexShaderName, const char* fragmentShaderName);
+
+    // dependsOn must have been added before asset, so there can't be a cycle.
+    bool addDependency(uint32_t asset, uint32_t dependsOn);
+
+    // Adds the manifest's assets. Returns false, having added the lines before it, at the first
+    // line that isn't understood.
+    bool loadManifest(const char* path, bx::FileReaderI* _reader = nullptr);
+
+    // Queues every asset to be read on the workers. The shader paths are worked out here, with
+    // loadProgram's rules, so call after bgfx::init.
+    void start();
+
+    // Uploads every asset that is ready to be, then returns true if all of them are done. Call
+    // from the thread that submits to bgfx; once a frame behind a loading screen, say.
+    bool update();
+
+    // start, then update until everything is done, waiting on the workers in between.
+    void run();
+
+    //
+    uint32_t find(const char* name) const;
+
+    // False unless the asset was uploaded.
+    bool getMesh(uint32_t asset, Mesh& mesh) const;
+
+    //
+    bool getProgram(uint32_t asset, bgfx::ProgramHandle& program) const;
+
+    //
+    const PreloadTiming& getTiming(uint32_t asset) const;
+
+    // From start until the last asset was uploaded.
+    double getTotalSeconds() const { return totalSeconds; }
+
+    // What the slowest chain of reads and uploads took; the least startup could take with
+    // enough workers.
+    double getCriticalPathSeconds() const;
+
+    // Every asset's timings and the totals, with printf.
+    void printReport() const;
+
+  private:
+
+    Preloader(const Preloader&);
+    Preloader& operator=(const Preloader&);
+
+    struct Asset;
+
+    static void readAsset(void* userData);
+
+    uint32_t addAsset(const char* name, bool isProgram, const char* path0, const char* path1);
+
+    bx::CrtAllocator    allocator;   // workers allocate from it, so it must be thread safe
+    bx::Mutex           mutex;
+    bx::Semaphore       readDone;
+    GFX_VECTOR<Asset*>  assets;
+    int64_t             startTime;
+    double              totalSeconds;
+    uint32_t            reading;
+    uint32_t            uploaded;
+    bool                started;
+  };
+
+}
+
+#endif
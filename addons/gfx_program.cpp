@@ -21,56 +21,65 @@
 // SOFTWARE.
 
 #include "gfx_program.h"
+#include "gfx_hash.h"
+#include "gfx_mapped_file.h"
 #include <bx/readerwriter.h>
+#include <stdio.h>
 
 namespace GFX_NS
 {
 
-  namespace
+  void getShaderPath(char path[512], const char* shaderName)
   {
-    bgfx::ShaderHandle loadShader(const char* shaderName, bx::FileReaderI* reader)
-    {
-      char path[512];
+    path[0] = '\0';
 
-      switch(bgfx::getRendererType())
+    switch(bgfx::getRendererType())
+    {
+      default:
+      case bgfx::RendererType::Null: break;
+      case bgfx::RendererType::Direct3D9:
+      {
+        strcpy(path, "shaders/dx9/");
+      }
+      break;
+      case bgfx::RendererType::Direct3D11:
+      case bgfx::RendererType::Direct3D12:
+      {
+        strcpy(path, "shaders/dx11/");
+      }
+      break;
+      case bgfx::RendererType::OpenGLES:
       {
-        default:
-        case bgfx::RendererType::Null: break;
-        case bgfx::RendererType::Direct3D9:
-        {
-          strcpy(path, "shaders/dx9/");
-        }
-        break;
-        case bgfx::RendererType::Direct3D11:
-        case bgfx::RendererType::Direct3D12:
-        {
-          strcpy(path, "shaders/dx11/");
-        }
-        break;
-        case bgfx::RendererType::OpenGLES:
-        {
-          strcpy(path, "shaders/gles/");
-        }
-        break;
-        case bgfx::RendererType::OpenGL:
-        {
-          strcpy(path, "shader/glsl/");
-        }
-        break;
-        case bgfx::RendererType::Vulkan:
-        {
-          strcpy(path, "shader/vulkan/");
-        }
-        break;
-        case bgfx::RendererType::Metal:
-        {
-          strcpy(path, "shader/vulkan/");
-        }
-        break;
+        strcpy(path, "shaders/gles/");
       }
+      break;
+      case bgfx::RendererType::OpenGL:
+      {
+        strcpy(path, "shader/glsl/");
+      }
+      break;
+      case bgfx::RendererType::Vulkan:
+      {
+        strcpy(path, "shader/vulkan/");
+      }
+      break;
+      case bgfx::RendererType::Metal:
+      {
+        strcpy(path, "shader/vulkan/");
+      }
+      break;
+    }
+
+    strcat(path, shaderName);
+    strcat(path, ".bin");
+  }
 
-      strcat(path, shaderName);
-      strcat(path, ".bin");
+  namespace
+  {
+    bgfx::ShaderHandle loadShader(const char* shaderName, bx::FileReaderI* reader)
+    {
+      char path[512];
+      getShaderPath(path, shaderName);
 
       if (bx::open(reader, path) == 0)
       {
@@ -85,40 +94,313 @@ namespace GFX_NS
 
       return BGFX_INVALID_HANDLE;
     }
+
+    struct CacheEntry
+    {
+      uint64_t hash;
+      uint16_t next;       // in its bucket
+      bool     cached;
+      uint32_t refCount;
+      uint16_t shaders[2]; // a program's vertex and fragment shader
+    };
+
+    HashCache<CacheEntry> _shaders;
+    HashCache<CacheEntry> _programs;
+
+    uint64_t hashRenderer()
+    {
+      uint8_t type = uint8_t(bgfx::getRendererType());
+      return hashBytes(kHashSeed, &type, sizeof(type));
+    }
+
+    uint16_t acquireShader(const char* shaderName, bx::FileReaderI* reader)
+    {
+      uint64_t hash = hashString(hashRenderer(), shaderName);
+
+      uint16_t idx = _shaders.find(hash);
+      if (idx != kNoCacheEntry)
+      {
+        _shaders.entries[idx].refCount++;
+        return idx;
+      }
+
+      bgfx::ShaderHandle shader = loadShader(shaderName, reader);
+      if (shader.idx != bgfx::invalidHandle)
+        _shaders.insert(shader.idx, hash).refCount = 1;
+
+      return shader.idx;
+    }
+
+    void releaseShader(uint16_t idx)
+    {
+      CacheEntry* entry = _shaders.get(idx);
+      if (entry != nullptr && --entry->refCount == 0)
+      {
+        _shaders.remove(idx);
+
+        bgfx::ShaderHandle shader = { idx };
+        bgfx::destroyShader(shader);
+      }
+    }
+
+    // bgfx never has this many programs, so it can't be the idx of one.
+    const uint16_t kVariantNotLoaded = UINT16_MAX - 1;
+
+    struct VariantBase
+    {
+      char     vertexShaderName[512];
+      char     fragmentShaderName[512];
+      uint32_t vertexFeatures;
+      uint32_t fragmentFeatures;
+      bool     used;
+    };
+
+    GFX_VECTOR<VariantBase> _variantBases;
+    GFX_VECTOR<uint16_t>    _variants;   // kVariantsPerProgram for each base, by features
   }
 
-  bgfx::ProgramHandle loadProgram(const char* vertexShaderName, const char* fragmentShaderName, bx::FileReaderI* reader)
+  bgfx::ProgramHandle loadProgram(const char* vertexShaderName, const char* fragmentShaderName, bx::FileReaderI* reader, bx::AllocatorI* allocator)
   {
-    bgfx::ProgramHandle program = BGFX_INVALID_HANDLE;
-    bgfx::ShaderHandle vertexShader, fragmentShader;
+    uint64_t hash = hashString(hashString(hashRenderer(), vertexShaderName), fragmentShaderName);
+
+    bgfx::ProgramHandle program;
+    program.idx = _programs.find(hash);
+
+    if (program.idx != kNoCacheEntry)
+    {
+      _programs.entries[program.idx].refCount++;
+      return program;
+    }
+
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
 
     bool ownReader = false;
 
-#if BX_CONFIG_CRT_FILE_READER_WRITER
+#if GFX_CONFIG_MAPPED_FILE_READER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, MappedFileReader);
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
     if (reader == nullptr)
     {
-      reader = new bx::CrtFileReader();
+      reader = BX_NEW(allocator, bx::CrtFileReader);
       ownReader = true;
     }
 #endif
     
-    vertexShader = loadShader(vertexShaderName, reader);
+    bgfx::ShaderHandle vertexShader = { acquireShader(vertexShaderName, reader) };
+    bgfx::ShaderHandle fragmentShader = { bgfx::invalidHandle };
+    program.idx = bgfx::invalidHandle;
+
     if (vertexShader.idx != bgfx::invalidHandle)
     {
-      fragmentShader = loadShader(fragmentShaderName, reader);
+      fragmentShader.idx = acquireShader(fragmentShaderName, reader);
       if (fragmentShader.idx != bgfx::invalidHandle)
       {
-        program = bgfx::createProgram(vertexShader, fragmentShader, true);
+        // the shaders are kept for the other programs that use them.
+        program = bgfx::createProgram(vertexShader, fragmentShader, false);
       }
     }
-    
-#if BX_CONFIG_CRT_FILE_READER_WRITER
+
+    if (program.idx != bgfx::invalidHandle)
+    {
+      CacheEntry& entry = _programs.insert(program.idx, hash);
+      entry.refCount = 1;
+      entry.shaders[0] = vertexShader.idx;
+      entry.shaders[1] = fragmentShader.idx;
+    }
+    else
+    {
+      releaseShader(vertexShader.idx);
+      releaseShader(fragmentShader.idx);
+    }
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
     if (ownReader)
     {
-      delete reader;
+      BX_DELETE(allocator, reader);
     }
 #endif
 
     return program;
   }
+
+  void releaseProgram(bgfx::ProgramHandle program)
+  {
+    CacheEntry* entry = _programs.get(program.idx);
+    if (entry == nullptr)
+    {
+      if (program.idx != bgfx::invalidHandle)
+        bgfx::destroyProgram(program);
+      return;
+    }
+
+    if (--entry->refCount == 0)
+    {
+      uint16_t vertexShader = entry->shaders[0];
+      uint16_t fragmentShader = entry->shaders[1];
+
+      _programs.remove(program.idx);
+      bgfx::destroyProgram(program);
+
+      releaseShader(vertexShader);
+      releaseShader(fragmentShader);
+    }
+  }
+
+  void clearProgramCache()
+  {
+    for(size_t i=0;i < _programs.entries.size();i++)
+    {
+      if (_programs.entries[i].cached)
+      {
+        bgfx::ProgramHandle program = { uint16_t(i) };
+        bgfx::destroyProgram(program);
+      }
+    }
+
+    for(size_t i=0;i < _shaders.entries.size();i++)
+    {
+      if (_shaders.entries[i].cached)
+      {
+        bgfx::ShaderHandle shader = { uint16_t(i) };
+        bgfx::destroyShader(shader);
+      }
+    }
+
+    _programs = HashCache<CacheEntry>();
+    _shaders = HashCache<CacheEntry>();
+
+    for(size_t i=0;i < _variants.size();i++)
+      _variants[i] = kVariantNotLoaded;
+  }
+
+  PreloadedShaderReader::PreloadedShaderReader(const char (*_paths)[512], uint8_t* const* _data, const uint32_t* _size)
+    : paths(_paths), data(_data), size(_size), file(-1), pos(0)
+  {
+  }
+
+  int32_t PreloadedShaderReader::open(const char* _filePath)
+  {
+    for(int32_t i=0;i < 2;i++)
+    {
+      if (data[i] != nullptr && strcmp(paths[i], _filePath) == 0)
+      {
+        file = i;
+        pos = 0;
+        return 0;
+      }
+    }
+
+    return -1;
+  }
+
+  int32_t PreloadedShaderReader::close()
+  {
+    file = -1;
+    return 0;
+  }
+
+  int64_t PreloadedShaderReader::seek(int64_t _offset, bx::Whence::Enum _whence)
+  {
+    int64_t end = file >= 0 ? size[file] : 0;
+
+    switch(_whence)
+    {
+      case bx::Whence::Begin:   pos = _offset;       break;
+      case bx::Whence::Current: pos = pos + _offset; break;
+      case bx::Whence::End:     pos = end + _offset; break;
+    }
+
+    pos = pos < 0 ? 0 : (pos > end ? end : pos);
+    return pos;
+  }
+
+  int32_t PreloadedShaderReader::read(void* _data, int32_t _size)
+  {
+    if (file < 0)
+      return 0;
+
+    int64_t remaining = int64_t(size[file]) - pos;
+    int32_t count = _size < remaining ? _size : int32_t(remaining);
+    memcpy(_data, data[file] + pos, count);
+    pos += count;
+    return count;
+  }
+
+  void getVariantShaderName(char name[512], const char* baseName, uint32_t features)
+  {
+    if (features == 0)
+      snprintf(name, 512, "%s", baseName);
+    else
+      snprintf(name, 512, "%s_%x", baseName, features);
+  }
+
+  VariantProgram createVariantProgram(const char* vertexShaderName, const char* fragmentShaderName, uint32_t vertexFeatures, uint32_t fragmentFeatures)
+  {
+    uint16_t idx = 0;
+    while (idx < _variantBases.size() && _variantBases[idx].used)
+      idx++;
+
+    if (idx == _variantBases.size())
+    {
+      _variantBases.resize(idx + 1);
+      _variants.resize(_variants.size() + kVariantsPerProgram);
+    }
+
+    VariantBase& base = _variantBases[idx];
+    strncpy(base.vertexShaderName, vertexShaderName, sizeof(base.vertexShaderName) - 1);
+    base.vertexShaderName[sizeof(base.vertexShaderName) - 1] = '\0';
+    strncpy(base.fragmentShaderName, fragmentShaderName, sizeof(base.fragmentShaderName) - 1);
+    base.fragmentShaderName[sizeof(base.fragmentShaderName) - 1] = '\0';
+    base.vertexFeatures = vertexFeatures & (kVariantsPerProgram - 1);
+    base.fragmentFeatures = fragmentFeatures & (kVariantsPerProgram - 1);
+    base.used = true;
+
+    for(uint32_t i=0;i < kVariantsPerProgram;i++)
+      _variants[idx * kVariantsPerProgram + i] = kVariantNotLoaded;
+
+    VariantProgram program = { idx };
+    return program;
+  }
+
+  bgfx::ProgramHandle getVariant(VariantProgram program, uint32_t features)
+  {
+    const VariantBase& base = _variantBases[program.idx];
+    features &= base.vertexFeatures | base.fragmentFeatures;
+
+    uint16_t& variant = _variants[program.idx * kVariantsPerProgram + features];
+
+    if (variant == kVariantNotLoaded)
+    {
+      char vertexShaderName[512], fragmentShaderName[512];
+      getVariantShaderName(vertexShaderName, base.vertexShaderName, features & base.vertexFeatures);
+      getVariantShaderName(fragmentShaderName, base.fragmentShaderName, features & base.fragmentFeatures);
+
+      variant = loadProgram(vertexShaderName, fragmentShaderName).idx;
+    }
+
+    bgfx::ProgramHandle handle = { variant };
+    return handle;
+  }
+
+  void destroyVariantProgram(VariantProgram program)
+  {
+    for(uint32_t i=0;i < kVariantsPerProgram;i++)
+    {
+      uint16_t& variant = _variants[program.idx * kVariantsPerProgram + i];
+      if (variant != kVariantNotLoaded && variant != bgfx::invalidHandle)
+      {
+        bgfx::ProgramHandle handle = { variant };
+        releaseProgram(handle);
+      }
+      variant = kVariantNotLoaded;
+    }
+
+    _variantBases[program.idx].used = false;
+  }
+
 }
@@ -25,14 +25,82 @@
 
 #include "gfx.h"
 
-namespace bx
-{
-  struct FileReaderI;
-}
+#include <bx/readerwriter.h>
 
 namespace GFX_NS
 {
-  bgfx::ProgramHandle loadProgram(const char* vertexShaderPath, const char* fragmentShaderPath, bx::FileReaderI* _reader = nullptr);
+  // The compiled shader's file, under the shaders directory for the current renderer.
+  void getShaderPath(char path[512], const char* shaderName);
+
+  // Programs are cached by renderer type and shader names, and their shaders by renderer type
+  // and name, so loading a program again is a lookup, and programs that share a shader share
+  // one bgfx shader. Each loadProgram is matched by a releaseProgram rather than a
+  // bgfx::destroyProgram. The reader, when one is made, comes from _allocator, or
+  // getDefaultAllocator() if it is nullptr; it is only used the first time a shader is loaded.
+  bgfx::ProgramHandle loadProgram(const char* vertexShaderPath, const char* fragmentShaderPath, bx::FileReaderI* _reader = nullptr, bx::AllocatorI* _allocator = nullptr);
+
+  // Destroys the program once every loadProgram of it is released, and its shaders once no
+  // cached program uses them. Programs that didn't come from loadProgram are destroyed.
+  void releaseProgram(bgfx::ProgramHandle program);
+
+  // Destroys every cached program and shader, however many loadPrograms haven't been released,
+  // and empties the cache; loaded variants are forgotten and load again when next asked for.
+  // Call before bgfx::shutdown, as the cache's handles mean nothing to a later bgfx::init.
+  void clearProgramCache();
+
+  // Serves shaders that were already read, e.g. on a worker, to loadProgram by the paths they
+  // were read from, so they go through its cache. paths, data and size are each two long, for
+  // the vertex and the fragment shader, and are borrowed; a nullptr data is a shader that isn't
+  // there.
+  class PreloadedShaderReader : public bx::FileReaderI
+  {
+  public:
+
+    PreloadedShaderReader(const char (*_paths)[512], uint8_t* const* _data, const uint32_t* _size);
+
+    virtual int32_t open(const char* _filePath);
+    virtual int32_t close();
+    virtual int64_t seek(int64_t _offset = 0, bx::Whence::Enum _whence = bx::Whence::Current);
+    virtual int32_t read(void* _data, int32_t _size);
+
+  private:
+
+    const char (*paths)[512];
+    uint8_t* const* data;
+    const uint32_t* size;
+    int32_t         file;
+    int64_t         pos;
+  };
+
+  // Shader variants; a program requested by its base shader names and a bitmask of features
+  // (skinning, fog, alpha test, ...). Each variant is a pair of prebuilt shaders, named after
+  // the base and the features that shader has, in hex: "vs_mesh" with features 0x5 is
+  // "vs_mesh_5", and with none it is "vs_mesh". Variants are loaded with loadProgram the first
+  // time they are asked for, and then kept in a flat table indexed by base and features, so
+  // getVariant is an array lookup.
+  static const uint32_t kMaxVariantFeatures = 8;
+  static const uint32_t kVariantsPerProgram = 1 << kMaxVariantFeatures;
+
+  struct VariantProgram
+  {
+    uint16_t idx;
+  };
+
+  // The name of a base shader's variant with features.
+  void getVariantShaderName(char name[512], const char* baseName, uint32_t features);
+
+  // Nothing is loaded yet. vertexFeatures and fragmentFeatures are the features each shader has
+  // variants for; a variant's shaders are named with only their own features, so a feature that
+  // only changes one of them doesn't need a copy of the other.
+  VariantProgram createVariantProgram(const char* vertexShaderName, const char* fragmentShaderName, uint32_t vertexFeatures, uint32_t fragmentFeatures);
+
+  // The variant with features, loading it if this is the first time it is asked for. Features
+  // neither shader has are ignored. Returns an invalid handle if its shaders can't be loaded,
+  // without trying again. Call from the thread that submits to bgfx.
+  bgfx::ProgramHandle getVariant(VariantProgram program, uint32_t features);
+
+  // Releases every variant that was loaded.
+  void destroyVariantProgram(VariantProgram program);
 }
 
 #endif
@@ -0,0 +1,282 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_residency.h"
+#include "gfx_async.h"
+
+#include <stdlib.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    struct ResidentEntry
+    {
+      char           path[512];
+      ResidencyState state;
+      Mesh           mesh;
+      uint32_t       size;
+      uint32_t       lastDrawn;
+      AsyncHandle    load;
+    };
+
+    struct Residency
+    {
+      Residency()
+        : budget(kDefaultMeshBudget),
+          bytes(0),
+          resident(0),
+          loading(0),
+          evictions(0),
+          loads(0),
+          frame(0)
+      {
+      }
+
+      HandlePool<ResidentEntry, ResidentMesh> entries;
+      GFX_VECTOR<uint32_t>      evictable; // into entries.data(), kept to save allocating it every frame
+      size_t                    budget;
+      size_t                    bytes;
+      uint32_t                  resident;
+      uint32_t                  loading;
+      uint32_t                  evictions;
+      uint32_t                  loads;
+      uint32_t                  frame;
+    };
+
+    Residency _residency;
+
+    ResidentEntry* getEntry(ResidentMesh mesh)
+    {
+      return _residency.entries.get(mesh);
+    }
+
+    void destroyMesh(ResidentEntry& entry)
+    {
+      bgfx::destroyVertexBuffer(entry.mesh.vertexBuffer);
+      if (entry.mesh.indexBuffer.idx != bgfx::invalidHandle)
+        bgfx::destroyIndexBuffer(entry.mesh.indexBuffer);
+
+      entry.mesh.vertexBuffer.idx = bgfx::invalidHandle;
+      entry.mesh.indexBuffer.idx = bgfx::invalidHandle;
+
+      _residency.bytes -= entry.size;
+      _residency.resident--;
+    }
+
+    // called by updateAsync; userData is the ResidentMesh, which can't have been removed, as
+    // removing it releases the load without a callback.
+    void onMeshLoaded(AsyncHandle handle, const Mesh& mesh, void* userData)
+    {
+      ResidentMesh id = { uint32_t(uintptr_t(userData)) };
+      ResidentEntry& entry = *getEntry(id);
+
+      entry.load.idx = UINT16_MAX;
+      _residency.loading--;
+
+      if (mesh.vertexBuffer.idx != bgfx::invalidHandle)
+      {
+        entry.state = ResidencyState::Resident;
+        entry.mesh = mesh;
+        entry.size = getAsyncSize(handle);
+
+        _residency.bytes += entry.size;
+        _residency.resident++;
+      }
+      else
+      {
+        entry.state = ResidencyState::Failed;
+      }
+
+      releaseAsync(handle);
+    }
+
+    void startLoad(ResidentMesh id, ResidentEntry& entry)
+    {
+      // when every async load is in use, it is tried again the next time it is drawn.
+      entry.load = loadTextMeshAsync(entry.path, onMeshLoaded, (void*) uintptr_t(id.value));
+      if (entry.load.idx == UINT16_MAX)
+        return;
+
+      entry.state = ResidencyState::Loading;
+      _residency.loading++;
+      _residency.loads++;
+    }
+
+    int compareLastDrawn(const void* a, const void* b)
+    {
+      uint32_t lastDrawnA = _residency.entries.data()[*(const uint32_t*) a].lastDrawn;
+      uint32_t lastDrawnB = _residency.entries.data()[*(const uint32_t*) b].lastDrawn;
+      return lastDrawnA < lastDrawnB ? -1 : (lastDrawnA > lastDrawnB ? 1 : 0);
+    }
+
+    // Returns 0 when every slot is in use.
+    ResidentMesh addEntry(const char* path)
+    {
+      ResidentEntry entry;
+      strncpy(entry.path, path, sizeof(entry.path) - 1);
+      entry.path[sizeof(entry.path) - 1] = '\0';
+      entry.state = ResidencyState::Evicted;
+      entry.mesh.vertexBuffer.idx = bgfx::invalidHandle;
+      entry.mesh.indexBuffer.idx = bgfx::invalidHandle;
+      entry.size = 0;
+      entry.lastDrawn = _residency.frame;
+      entry.load.idx = UINT16_MAX;
+      entry.load.generation = 0;
+
+      return _residency.entries.create(entry);
+    }
+  }
+
+  ResidentMesh addResidentMesh(const char* path)
+  {
+    return addEntry(path);
+  }
+
+  ResidentMesh addResidentMesh(const char* path, const Mesh& mesh, uint32_t size)
+  {
+    ResidentMesh handle = addEntry(path);
+
+    ResidentEntry* added = getEntry(handle);
+    if (added == nullptr)
+      return handle;
+
+    ResidentEntry& entry = *added;
+    entry.state = ResidencyState::Resident;
+    entry.mesh = mesh;
+    entry.size = size;
+
+    _residency.bytes += size;
+    _residency.resident++;
+    _residency.loads++;
+
+    return handle;
+  }
+
+  void removeResidentMesh(ResidentMesh mesh)
+  {
+    ResidentEntry* entry = getEntry(mesh);
+    if (entry == nullptr)
+      return;
+
+    if (entry->state == ResidencyState::Resident)
+    {
+      destroyMesh(*entry);
+    }
+    else if (entry->state == ResidencyState::Loading)
+    {
+      // gfx_async destroys it once it has loaded, without calling back.
+      releaseAsync(entry->load);
+      _residency.loading--;
+    }
+
+    ResidentEntry removed;
+    _residency.entries.destroy(mesh, removed);
+  }
+
+  bool getResidentMesh(ResidentMesh mesh, Mesh& out)
+  {
+    ResidentEntry* entry = getEntry(mesh);
+    if (entry == nullptr)
+      return false;
+
+    entry->lastDrawn = _residency.frame;
+
+    if (entry->state == ResidencyState::Evicted)
+      startLoad(mesh, *entry);
+
+    if (entry->state != ResidencyState::Resident)
+      return false;
+
+    out = entry->mesh;
+    return true;
+  }
+
+  void draw(ResidentMesh mesh)
+  {
+    Mesh resident;
+    if (getResidentMesh(mesh, resident))
+      draw(resident);
+  }
+
+  void getResidentMeshInfo(ResidentMesh mesh, ResidentMeshInfo& info)
+  {
+    ResidentEntry* entry = getEntry(mesh);
+
+    info.state = entry != nullptr ? entry->state : ResidencyState::Invalid;
+    info.size = entry != nullptr ? entry->size : 0;
+    info.lastDrawn = entry != nullptr ? entry->lastDrawn : 0;
+  }
+
+  void setMeshBudget(size_t bytes)
+  {
+    _residency.budget = bytes;
+  }
+
+  size_t getMeshBudget()
+  {
+    return _residency.budget;
+  }
+
+  void updateResidency()
+  {
+    if (_residency.bytes > _residency.budget)
+    {
+      GFX_VECTOR<uint32_t>& evictable = _residency.evictable;
+      evictable.clear();
+
+      ResidentEntry* entries = _residency.entries.data();
+      for(uint32_t i=0;i < _residency.entries.size();i++)
+      {
+        const ResidentEntry& entry = entries[i];
+        if (entry.state == ResidencyState::Resident && entry.lastDrawn != _residency.frame)
+          evictable.push_back(i);
+      }
+
+      if (evictable.empty() == false)
+        qsort(&evictable[0], evictable.size(), sizeof(uint32_t), compareLastDrawn);
+
+      for(size_t i=0;i < evictable.size() && _residency.bytes > _residency.budget;i++)
+      {
+        ResidentEntry& entry = entries[evictable[i]];
+        destroyMesh(entry);
+        entry.state = ResidencyState::Evicted;
+        _residency.evictions++;
+      }
+    }
+
+    _residency.frame++;
+  }
+
+  void getResidencyStats(ResidencyStats& stats)
+  {
+    stats.bytes = _residency.bytes;
+    stats.resident = _residency.resident;
+    stats.loading = _residency.loading;
+    stats.evictions = _residency.evictions;
+    stats.loads = _residency.loads;
+    stats.frame = _residency.frame;
+  }
+
+}
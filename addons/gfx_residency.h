@@ -0,0 +1,114 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_RESIDENCY_H
+#define GFX_RESIDENCY_H
+
+#include "gfx.h"
+
+namespace GFX_NS
+{
+
+  // Meshes that are kept on the GPU only while they are drawn. Each one is registered with the
+  // text mesh it comes from, and the registry records its size and the last frame it was drawn
+  // in. When the meshes on the GPU go over the budget, those drawn least recently are destroyed,
+  // and they are loaded again with gfx_async the next time they are drawn.
+  //
+  //   ResidentMesh rock = addResidentMesh("rock.txt");
+  //   ...
+  //   draw(rock);                 // nothing is drawn until it has loaded
+  //   updateAsync();
+  //   updateResidency();          // once a frame
+  //   frame();
+
+  static const size_t kDefaultMeshBudget = 256 * 1024 * 1024;
+
+  // A HandlePool id, so one kept after removeResidentMesh finds nothing rather than whatever
+  // was added in its place. 0 is never an id.
+  struct ResidentMesh
+  {
+    uint32_t value;
+  };
+
+  enum class ResidencyState
+  {
+    Invalid,   // not a handle, or removed
+    Evicted,   // not loaded, or destroyed to keep to the budget
+    Loading,
+    Resident,
+    Failed     // couldn't be loaded; it isn't tried again
+  };
+
+  struct ResidentMeshInfo
+  {
+    ResidencyState state;
+    uint32_t       size;       // of the vertex and index data, once it has been loaded
+    uint32_t       lastDrawn;  // frame, as counted by updateResidency
+  };
+
+  // Nothing is loaded until the mesh is first drawn. Returns 0 if every slot is in use.
+  ResidentMesh addResidentMesh(const char* path);
+
+  // A mesh that has already been created from path, with size bytes of vertex and index data.
+  // The registry owns it from now on, unless 0 is returned.
+  ResidentMesh addResidentMesh(const char* path, const Mesh& mesh, uint32_t size);
+
+  // Destroys the mesh, if it is on the GPU, and releases the handle.
+  void removeResidentMesh(ResidentMesh mesh);
+
+  // Counts as drawing it. If it isn't on the GPU, it starts loading and false is returned.
+  bool getResidentMesh(ResidentMesh mesh, Mesh& out);
+
+  // Draws the mesh if it is on the GPU, and otherwise starts it loading.
+  void draw(ResidentMesh mesh);
+
+  //
+  void getResidentMeshInfo(ResidentMesh mesh, ResidentMeshInfo& info);
+
+  // Meshes are evicted by updateResidency. Meshes drawn in the current frame never are, so the
+  // budget can be gone over while they are all in use.
+  void setMeshBudget(size_t bytes);
+
+  //
+  size_t getMeshBudget();
+
+  // Evicts the meshes drawn least recently until the rest fit in the budget, then starts the
+  // next frame. Call once a frame, after updateAsync.
+  void updateResidency();
+
+  struct ResidencyStats
+  {
+    size_t   bytes;       // on the GPU
+    uint32_t resident;
+    uint32_t loading;
+    uint32_t evictions;   // since the start
+    uint32_t loads;       // since the start, including the first
+    uint32_t frame;
+  };
+
+  //
+  void getResidencyStats(ResidencyStats& stats);
+
+}
+
+#endif
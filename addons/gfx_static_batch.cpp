@@ -0,0 +1,497 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_static_batch.h"
+
+#include <bx/fpumath.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#if BX_CPU_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define GFX_STATIC_BATCH_SSE2 1
+#else
+# define GFX_STATIC_BATCH_SSE2 0
+#endif
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    // Transforms the float xyz at offset in each vertex by m, as a point, and grows the box
+    // around them.
+    void transformPositions(uint8_t* data, size_t vertexCount, size_t stride, const float* m, float* minimum, float* maximum)
+    {
+#if GFX_STATIC_BATCH_SSE2
+      const __m128 row0 = _mm_loadu_ps(&m[0]);
+      const __m128 row1 = _mm_loadu_ps(&m[4]);
+      const __m128 row2 = _mm_loadu_ps(&m[8]);
+      const __m128 row3 = _mm_loadu_ps(&m[12]);
+
+      __m128 lo = _mm_set1_ps(FLT_MAX);
+      __m128 hi = _mm_set1_ps(-FLT_MAX);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = (float*) (data + i * stride);
+
+        __m128 r = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), row0), _mm_mul_ps(_mm_set1_ps(p[1]), row1)),
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[2]), row2), row3));
+
+        lo = _mm_min_ps(lo, r);
+        hi = _mm_max_ps(hi, r);
+
+        // three lanes; the fourth float may be the next attribute.
+        _mm_storel_pi((__m64*) p, r);
+        _mm_store_ss(p + 2, _mm_movehl_ps(r, r));
+      }
+
+      float l[4], h[4];
+      _mm_storeu_ps(l, lo);
+      _mm_storeu_ps(h, hi);
+      for(size_t k=0;k < 3;k++)
+      {
+        minimum[k] = bx::fmin(minimum[k], l[k]);
+        maximum[k] = bx::fmax(maximum[k], h[k]);
+      }
+#else
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = (float*) (data + i * stride);
+
+        float r[3];
+        bx::vec3MulMtx(r, p, m);
+        memcpy(p, r, sizeof(r));
+
+        bx::vec3Min(minimum, minimum, r);
+        bx::vec3Max(maximum, maximum, r);
+      }
+#endif
+    }
+
+    // Transforms the float xyz at each vertex by the 3x3 in rows, as a direction, and normalises it.
+    void transformDirections(uint8_t* data, size_t vertexCount, size_t stride, const float rows[3][4])
+    {
+#if GFX_STATIC_BATCH_SSE2
+      const __m128 row0 = _mm_loadu_ps(rows[0]);
+      const __m128 row1 = _mm_loadu_ps(rows[1]);
+      const __m128 row2 = _mm_loadu_ps(rows[2]);
+      const __m128 tiny = _mm_set_ss(1e-20f);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = (float*) (data + i * stride);
+
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), row0), _mm_mul_ps(_mm_set1_ps(p[1]), row1)), _mm_mul_ps(_mm_set1_ps(p[2]), row2));
+
+        // x*x + y*y + z*z in the first lane; the fourth is 0, as the rows' are.
+        __m128 sq = _mm_mul_ps(r, r);
+        __m128 sum = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(sq, sq));
+        __m128 length = _mm_sqrt_ss(_mm_max_ss(sum, tiny));
+        r = _mm_div_ps(r, _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0)));
+
+        _mm_storel_pi((__m64*) p, r);
+        _mm_store_ss(p + 2, _mm_movehl_ps(r, r));
+      }
+#else
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float* p = (float*) (data + i * stride);
+
+        float r[3];
+        for(size_t k=0;k < 3;k++)
+          r[k] = p[0] * rows[0][k] + p[1] * rows[1][k] + p[2] * rows[2][k];
+
+        float length = bx::vec3Length(r);
+        if (length > 0.0f)
+          bx::vec3Mul(r, r, 1.0f / length);
+
+        memcpy(p, r, sizeof(r));
+      }
+#endif
+    }
+
+    // As transformDirections, for attributes that aren't floats.
+    void transformPackedDirections(uint8_t* data, size_t vertexCount, const bgfx::VertexDecl& decl, bgfx::Attrib::Enum attrib, const float rows[3][4])
+    {
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      decl.decode(attrib, num, type, normalised, asInt);
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float v[4];
+        bgfx::vertexUnpack(v, attrib, decl, data, uint32_t(i));
+
+        // normalised bytes unpack to 0..1.
+        if (type == bgfx::AttribType::Uint8 && normalised)
+        {
+          for(size_t k=0;k < 4;k++)
+            v[k] = v[k] * 2.0f - 1.0f;
+        }
+
+        float r[3];
+        for(size_t k=0;k < 3;k++)
+          r[k] = v[0] * rows[0][k] + v[1] * rows[1][k] + v[2] * rows[2][k];
+
+        float length = bx::vec3Length(r);
+        if (length > 0.0f)
+          bx::vec3Mul(v, r, 1.0f / length);
+
+        bgfx::vertexPack(v, true, attrib, decl, data, uint32_t(i));
+      }
+    }
+
+    void transformAttribute(uint8_t* data, size_t vertexCount, const bgfx::VertexDecl& decl, bgfx::Attrib::Enum attrib, const float rows[3][4])
+    {
+      if (decl.has(attrib) == false)
+        return;
+
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      decl.decode(attrib, num, type, normalised, asInt);
+
+      if (type == bgfx::AttribType::Float && num >= 3)
+        transformDirections(data + decl.getOffset(attrib), vertexCount, decl.getStride(), rows);
+      else
+        transformPackedDirections(data, vertexCount, decl, attrib, rows);
+    }
+
+    // The handedness in a tangent's w flips with a mirroring transform.
+    void flipHandedness(uint8_t* data, size_t vertexCount, const bgfx::VertexDecl& decl)
+    {
+      if (decl.has(bgfx::Attrib::Tangent) == false)
+        return;
+
+      uint8_t num;
+      bgfx::AttribType::Enum type;
+      bool normalised, asInt;
+      decl.decode(bgfx::Attrib::Tangent, num, type, normalised, asInt);
+
+      if (num < 4)
+        return;
+
+      for(size_t i=0;i < vertexCount;i++)
+      {
+        float v[4];
+        bgfx::vertexUnpack(v, bgfx::Attrib::Tangent, decl, data, uint32_t(i));
+
+        if (type == bgfx::AttribType::Uint8 && normalised)
+        {
+          for(size_t k=0;k < 4;k++)
+            v[k] = v[k] * 2.0f - 1.0f;
+        }
+
+        v[3] = -v[3];
+        bgfx::vertexPack(v, true, bgfx::Attrib::Tangent, decl, data, uint32_t(i));
+      }
+    }
+  }
+
+  StaticBatchBuilder::StaticBatchBuilder(const bgfx::VertexDecl& _decl, float _cellSize)
+    : decl(_decl),
+      cellSize(_cellSize > 0.0f ? _cellSize : 1.0f)
+  {
+  }
+
+  bool StaticBatchBuilder::add(const MeshData& meshData, const Matrix& world)
+  {
+    if (meshData.decl.m_hash != decl.m_hash || decl.has(bgfx::Attrib::Position) == false)
+      return false;
+
+    uint8_t num;
+    bgfx::AttribType::Enum type;
+    bool normalised, asInt;
+    decl.decode(bgfx::Attrib::Position, num, type, normalised, asInt);
+
+    size_t vertexCount = getVertexCount(meshData);
+    size_t indexCount = getIndexCount(meshData);
+
+    // a cell's indices are 16 bit, from the first vertex of its range.
+    if (type != bgfx::AttribType::Float || num < 3 || vertexCount == 0 || vertexCount > UINT16_MAX + 1)
+      return false;
+
+    // directions are transformed as xyz; two components would be octahedral, and can't be.
+    const bgfx::Attrib::Enum directions[] = { bgfx::Attrib::Normal, bgfx::Attrib::Tangent, bgfx::Attrib::Bitangent };
+    for(size_t i=0;i < BX_COUNTOF(directions);i++)
+    {
+      if (decl.has(directions[i]) == false)
+        continue;
+
+      decl.decode(directions[i], num, type, normalised, asInt);
+      if (num < 3)
+        return false;
+    }
+
+    Instance instance;
+    instance.firstVertex = uint32_t(vertices.size() / decl.getStride());
+    instance.vertexCount = uint32_t(vertexCount);
+    instance.firstIndex = uint32_t(indices.size());
+    instance.indexCount = uint32_t(indexCount);
+
+    vertices.resize(vertices.size() + meshData.vertexData.size);
+    uint8_t* data = &vertices[instance.firstVertex * decl.getStride()];
+    memcpy(data, meshData.vertexData.data, meshData.vertexData.size);
+
+    const float* m = world.ptr();
+
+    for(size_t k=0;k < 3;k++)
+    {
+      instance.minimum[k] = FLT_MAX;
+      instance.maximum[k] = -FLT_MAX;
+    }
+
+    transformPositions(data + decl.getOffset(bgfx::Attrib::Position), vertexCount, decl.getStride(), m, instance.minimum, instance.maximum);
+
+    // tangents and bitangents lie in the surface, so they go by the matrix; normals go by its
+    // inverse transpose, which for rows a, b and c is (b x c, c x a, a x b) over the determinant.
+    float tangentRows[3][4], normalRows[3][4];
+    for(size_t r=0;r < 3;r++)
+    {
+      memcpy(tangentRows[r], &m[r * 4], sizeof(float) * 3);
+      tangentRows[r][3] = 0.0f;
+    }
+
+    bx::vec3Cross(normalRows[0], &m[4], &m[8]);
+    bx::vec3Cross(normalRows[1], &m[8], &m[0]);
+    bx::vec3Cross(normalRows[2], &m[0], &m[4]);
+
+    float determinant = bx::vec3Dot(&m[0], normalRows[0]);
+    float sign = determinant < 0.0f ? -1.0f : 1.0f;
+    for(size_t r=0;r < 3;r++)
+    {
+      bx::vec3Mul(normalRows[r], normalRows[r], sign);
+      normalRows[r][3] = 0.0f;
+    }
+
+    transformAttribute(data, vertexCount, decl, bgfx::Attrib::Normal, normalRows);
+    transformAttribute(data, vertexCount, decl, bgfx::Attrib::Tangent, tangentRows);
+    transformAttribute(data, vertexCount, decl, bgfx::Attrib::Bitangent, tangentRows);
+
+    indices.resize(indices.size() + indexCount);
+    if (indexCount > 0)
+      memcpy(&indices[instance.firstIndex], meshData.indexData.data, indexCount * sizeof(uint16_t));
+
+    // a mirroring transform turns the triangles inside out.
+    if (determinant < 0.0f)
+    {
+      flipHandedness(data, vertexCount, decl);
+
+      for(size_t i=0;i + 2 < indexCount;i += 3)
+      {
+        uint16_t t = indices[instance.firstIndex + i + 1];
+        indices[instance.firstIndex + i + 1] = indices[instance.firstIndex + i + 2];
+        indices[instance.firstIndex + i + 2] = t;
+      }
+    }
+
+    for(size_t k=0;k < 3;k++)
+      instance.cell[k] = int32_t(floorf((instance.minimum[k] + instance.maximum[k]) * 0.5f / cellSize));
+
+    instances.push_back(instance);
+    return true;
+  }
+
+  int StaticBatchBuilder::compareCells(const void* a, const void* b)
+  {
+    const Instance& ia = *(const Instance*) a;
+    const Instance& ib = *(const Instance*) b;
+
+    for(size_t k=0;k < 3;k++)
+    {
+      if (ia.cell[k] != ib.cell[k])
+        return ia.cell[k] < ib.cell[k] ? -1 : 1;
+    }
+
+    // as they were added, within a cell.
+    return ia.firstVertex < ib.firstVertex ? -1 : (ia.firstVertex > ib.firstVertex ? 1 : 0);
+  }
+
+  void StaticBatchBuilder::build(StaticBatch& batch)
+  {
+    batch.vertexBuffer.idx = bgfx::invalidHandle;
+    batch.indexBuffer.idx = bgfx::invalidHandle;
+    batch.cells.clear();
+
+    if (instances.empty() == false)
+    {
+      qsort(&instances[0], instances.size(), sizeof(Instance), compareCells);
+
+      uint32_t stride = decl.getStride();
+      const bgfx::Memory* vertexMem = bgfx::alloc(uint32_t(vertices.size()));
+      const bgfx::Memory* indexMem = bgfx::alloc(uint32_t(indices.size() * sizeof(uint16_t)));
+      uint16_t* outIndices = (uint16_t*) indexMem->data;
+
+      uint32_t vertexCount = 0, indexCount = 0;
+      StaticBatchCell cell;
+
+      for(size_t i=0;i < instances.size();i++)
+      {
+        const Instance& instance = instances[i];
+
+        // a new cell of the grid, or one that has run out of 16 bit indices.
+        bool sameCell = i > 0 && memcmp(instance.cell, instances[i - 1].cell, sizeof(instance.cell)) == 0;
+        if (i == 0 || sameCell == false || vertexCount - cell.mesh.firstVertex + instance.vertexCount > UINT16_MAX + 1)
+        {
+          if (i > 0)
+            batch.cells.push_back(cell);
+
+          Mesh none = { BGFX_INVALID_HANDLE, BGFX_INVALID_HANDLE };
+          cell.mesh = makeMeshRange(none);
+          cell.mesh.firstVertex = vertexCount;
+          cell.mesh.vertexCount = 0;
+          cell.mesh.firstIndex = indexCount;
+          cell.mesh.indexCount = 0;
+          for(size_t k=0;k < 3;k++)
+          {
+            cell.minimum[k] = FLT_MAX;
+            cell.maximum[k] = -FLT_MAX;
+          }
+        }
+
+        memcpy(vertexMem->data + vertexCount * stride, &vertices[instance.firstVertex * stride], instance.vertexCount * stride);
+
+        uint16_t base = uint16_t(vertexCount - cell.mesh.firstVertex);
+        for(uint32_t j=0;j < instance.indexCount;j++)
+          outIndices[indexCount + j] = uint16_t(indices[instance.firstIndex + j] + base);
+
+        vertexCount += instance.vertexCount;
+        indexCount += instance.indexCount;
+        cell.mesh.vertexCount += instance.vertexCount;
+        cell.mesh.indexCount += instance.indexCount;
+
+        bx::vec3Min(cell.minimum, cell.minimum, instance.minimum);
+        bx::vec3Max(cell.maximum, cell.maximum, instance.maximum);
+      }
+
+      batch.cells.push_back(cell);
+
+      batch.vertexBuffer = bgfx::createVertexBuffer(vertexMem, decl);
+      batch.indexBuffer = bgfx::createIndexBuffer(indexMem);
+
+      for(size_t i=0;i < batch.cells.size();i++)
+      {
+        batch.cells[i].mesh.vertexBuffer = batch.vertexBuffer;
+        batch.cells[i].mesh.indexBuffer = batch.indexBuffer;
+      }
+    }
+
+    instances.clear();
+    GFX_VECTOR<uint8_t>().swap(vertices);
+    GFX_VECTOR<uint16_t>().swap(indices);
+  }
+
+  void destroyStaticBatch(StaticBatch& batch)
+  {
+    if (batch.vertexBuffer.idx != bgfx::invalidHandle)
+      bgfx::destroyVertexBuffer(batch.vertexBuffer);
+    if (batch.indexBuffer.idx != bgfx::invalidHandle)
+      bgfx::destroyIndexBuffer(batch.indexBuffer);
+
+    batch.vertexBuffer.idx = bgfx::invalidHandle;
+    batch.indexBuffer.idx = bgfx::invalidHandle;
+    batch.cells.clear();
+  }
+
+  void cullStaticBatch(GFX_VECTOR<uint32_t>& visible, const StaticBatch& batch, const Matrix& model, const Matrix& view, const Matrix& projection)
+  {
+    size_t first = visible.size();
+    visible.resize(first + batch.cells.size());
+
+    size_t count = batch.cells.empty() == false ? cullStaticBatch(&visible[first], batch, model, view, projection) : 0;
+    visible.resize(first + count);
+  }
+
+  size_t cullStaticBatch(uint32_t* visible, const StaticBatch& batch, const Matrix& model, const Matrix& view, const Matrix& projection)
+  {
+    size_t count = 0;
+
+    float modelView[16], modelViewProj[16];
+    bx::mtxMul(modelView, model.ptr(), view.ptr());
+    bx::mtxMul(modelViewProj, modelView, projection.ptr());
+
+    // as cullMeshlets; frustum planes in model space from the columns of the clip matrix.
+    float planes[6][4];
+    for(size_t i=0;i < 4;i++)
+    {
+      float c0 = modelViewProj[i * 4 + 0];
+      float c1 = modelViewProj[i * 4 + 1];
+      float c2 = modelViewProj[i * 4 + 2];
+      float c3 = modelViewProj[i * 4 + 3];
+
+      planes[0][i] = c3 + c0;
+      planes[1][i] = c3 - c0;
+      planes[2][i] = c3 + c1;
+      planes[3][i] = c3 - c1;
+      planes[4][i] = c3 + c2;
+      planes[5][i] = c3 - c2;
+    }
+
+    for(size_t c=0;c < batch.cells.size();c++)
+    {
+      const StaticBatchCell& cell = batch.cells[c];
+
+      // outside if the box's corner furthest along a plane's normal is behind it.
+      bool inside = true;
+      for(size_t p=0;p < 6 && inside;p++)
+      {
+        float corner[3];
+        for(size_t k=0;k < 3;k++)
+          corner[k] = planes[p][k] >= 0.0f ? cell.maximum[k] : cell.minimum[k];
+
+        if (bx::vec3Dot(planes[p], corner) + planes[p][3] < 0.0f)
+          inside = false;
+      }
+
+      if (inside)
+        visible[count++] = uint32_t(c);
+    }
+
+    return count;
+  }
+
+  void draw(const StaticBatch& batch)
+  {
+    if (batch.cells.empty())
+      return;
+
+    Matrix model = getModelMatrix();
+
+    uint32_t* visible = frameAlloc<uint32_t>(batch.cells.size());
+    size_t count = cullStaticBatch(visible, batch, model, getViewMatrix(), getProjectionMatrix());
+
+    for(size_t i=0;i < count;i++)
+    {
+      // bgfx forgets the transform after each submit, so every cell is drawn with the model it
+      // was culled with.
+      setModelMatrix(model);
+      draw(batch.cells[visible[i]].mesh);
+    }
+  }
+
+}
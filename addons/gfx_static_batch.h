@@ -0,0 +1,118 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_STATIC_BATCH_H
+#define GFX_STATIC_BATCH_H
+
+#include "gfx.h"
+#include "gfx_mesh.h"
+
+namespace GFX_NS
+{
+
+  // Static props that share a vertex decl, merged into one vertex and one index buffer with
+  // their vertices already in world space, so drawing hundreds of them is a handful of draws.
+  // They are grouped by a grid over the world, and each cell of it is drawn on its own, so what
+  // is off screen can still be culled.
+  //
+  //   StaticBatchBuilder builder(decl, 32.0f);
+  //   for each prop
+  //     builder.add(propMeshData, propWorld);
+  //   StaticBatch batch;
+  //   builder.build(batch);
+  //   ...
+  //   setProgram(program);        // the same program and state for every prop
+  //   draw(batch);
+
+  // The props in one cell of the grid; a range of the batch's buffers, with a box around it.
+  struct StaticBatchCell
+  {
+    MeshRange mesh;
+    float     minimum[3];   // in world space
+    float     maximum[3];
+  };
+
+  struct StaticBatch
+  {
+    bgfx::VertexBufferHandle    vertexBuffer;
+    bgfx::IndexBufferHandle     indexBuffer;
+    GFX_VECTOR<StaticBatchCell> cells;
+  };
+
+  class StaticBatchBuilder
+  {
+  public:
+
+    // Props are put in the cell of the grid, cellSize across, that their box's centre is in.
+    StaticBatchBuilder(const bgfx::VertexDecl& decl, float cellSize);
+
+    // The vertices are transformed by world here, so meshData can go once this returns; its
+    // positions, and normals, tangents and bitangents, which are normalised again. Returns
+    // false if meshData's decl isn't the builder's, it has no float position, or it has a normal,
+    // tangent or bitangent of fewer than three components, such as an octahedral normal from
+    // quantiseMesh.
+    bool add(const MeshData& meshData, const Matrix& world);
+
+    // Creates batch's buffers. A cell with more vertices than 16 bit indices reach is split into
+    // several. The builder is left empty.
+    void build(StaticBatch& batch);
+
+  private:
+
+    struct Instance
+    {
+      uint32_t firstVertex;   // in vertices
+      uint32_t vertexCount;
+      uint32_t firstIndex;    // in indices
+      uint32_t indexCount;
+      int32_t  cell[3];
+      float    minimum[3];
+      float    maximum[3];
+    };
+
+    static int compareCells(const void* a, const void* b);
+
+    bgfx::VertexDecl       decl;
+    float                  cellSize;
+    GFX_VECTOR<Instance>   instances;
+    GFX_VECTOR<uint8_t>    vertices;   // transformed
+    GFX_VECTOR<uint16_t>   indices;    // as they were
+  };
+
+  //
+  void destroyStaticBatch(StaticBatch& batch);
+
+  // Appends the indices of the cells whose boxes are at least partly inside the view frustum.
+  void cullStaticBatch(GFX_VECTOR<uint32_t>& visible, const StaticBatch& batch, const Matrix& model, const Matrix& view, const Matrix& projection);
+
+  // As above, into visible, which must have room for all of the batch's cells. Returns the
+  // number written.
+  size_t cullStaticBatch(uint32_t* visible, const StaticBatch& batch, const Matrix& model, const Matrix& view, const Matrix& projection);
+
+  // Culls the cells with the current matrices, and draws what is left. The indices of the visible
+  // cells are kept in the calling thread's frame arena.
+  void draw(const StaticBatch& batch);
+
+}
+
+#endif
@@ -0,0 +1,280 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_task.h"
+
+#include <bx/cpu.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
+#include <bx/thread.h>
+#include <bx/uint32_t.h>
+#include <thread>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    struct Job
+    {
+      TaskFn fn;    // nullptr once cancelled
+      void* userData;
+    };
+
+    int32_t workerMain(void* userData);
+
+    struct WorkerPool
+    {
+      WorkerPool()
+        : head(0),
+          workerCount(UINT32_MAX),
+          runningCount(0),
+          quit(false)
+      {
+      }
+
+      ~WorkerPool()
+      {
+        stop();
+      }
+
+      // call with the mutex held.
+      uint32_t getCount()
+      {
+        if (workerCount == UINT32_MAX)
+        {
+          uint32_t cores = std::thread::hardware_concurrency();
+          workerCount = cores > 1 ? bx::uint32_min(cores - 1, kMaxWorkers) : 1;
+        }
+        return workerCount;
+      }
+
+      // call with the mutex held.
+      void start()
+      {
+        quit = false;
+        for(uint32_t count=getCount();runningCount < count;runningCount++)
+          threads[runningCount].init(workerMain, this);
+      }
+
+      void stop()
+      {
+        uint32_t count;
+        {
+          bx::MutexScope lock(mutex);
+          count = runningCount;
+          quit = true;
+        }
+
+        wake.post(count);
+
+        for(uint32_t i=0;i < count;i++)
+          threads[i].shutdown();
+
+        bx::MutexScope lock(mutex);
+        runningCount = 0;
+      }
+
+      void push(TaskFn fn, void* userData, uint32_t count)
+      {
+        {
+          bx::MutexScope lock(mutex);
+
+          if (runningCount == 0)
+            start();
+
+          Job job = { fn, userData };
+          for(uint32_t i=0;i < count;i++)
+            jobs.push_back(job);
+        }
+
+        wake.post(count);
+      }
+
+      // Cancels the queued jobs that haven't been picked up yet, returns how many there were.
+      uint32_t cancel(void* userData)
+      {
+        bx::MutexScope lock(mutex);
+
+        uint32_t cancelled = 0;
+        for(size_t i=head;i < jobs.size();i++)
+        {
+          if (jobs[i].fn != nullptr && jobs[i].userData == userData)
+          {
+            jobs[i].fn = nullptr;
+            cancelled++;
+          }
+        }
+        return cancelled;
+      }
+
+      bool pop(Job& job)
+      {
+        bx::MutexScope lock(mutex);
+
+        if (head == jobs.size())
+          return false;
+
+        job = jobs[head++];
+        if (head == jobs.size())
+        {
+          jobs.clear();
+          head = 0;
+        }
+        return true;
+      }
+
+      bx::Mutex        mutex;
+      bx::Semaphore    wake;      // posted once per queued job, and once per worker to quit
+      GFX_VECTOR<Job>  jobs;
+      size_t           head;
+      bx::Thread       threads[kMaxWorkers];
+      uint32_t         workerCount;
+      uint32_t         runningCount;
+      bool             quit;
+    };
+
+    WorkerPool sWorkers;
+
+    int32_t workerMain(void* userData)
+    {
+      WorkerPool& pool = *(WorkerPool*) userData;
+
+      for(;;)
+      {
+        pool.wake.wait();
+
+        Job job;
+        if (pool.pop(job))
+        {
+          if (job.fn != nullptr)
+            job.fn(job.userData);
+          continue;
+        }
+
+        bx::MutexScope lock(pool.mutex);
+        if (pool.quit)
+          break;
+      }
+
+      return 0;
+    }
+
+    struct ParallelFor
+    {
+      ParallelForFn    fn;
+      void*            userData;
+      size_t           count;
+      size_t           grain;
+      volatile uint32_t next;
+      bx::Semaphore    finished;
+    };
+
+    void runParallelFor(ParallelFor& work)
+    {
+      for(;;)
+      {
+        size_t begin = size_t(bx::atomicFetchAndAdd(&work.next, 1u)) * work.grain;
+        if (begin >= work.count)
+          break;
+
+        size_t end = begin + work.grain < work.count ? begin + work.grain : work.count;
+        work.fn(begin, end, work.userData);
+      }
+    }
+
+    void parallelForJob(void* userData)
+    {
+      ParallelFor& work = *(ParallelFor*) userData;
+      runParallelFor(work);
+      work.finished.post();
+    }
+  }
+
+  void setWorkerCount(uint32_t count)
+  {
+    sWorkers.stop();
+
+    bx::MutexScope lock(sWorkers.mutex);
+    sWorkers.workerCount = bx::uint32_min(count, kMaxWorkers);
+  }
+
+  uint32_t getWorkerCount()
+  {
+    bx::MutexScope lock(sWorkers.mutex);
+    return sWorkers.getCount();
+  }
+
+  void shutdownWorkers()
+  {
+    sWorkers.stop();
+  }
+
+  void runTask(TaskFn fn, void* userData)
+  {
+    if (getWorkerCount() == 0)
+    {
+      fn(userData);
+      return;
+    }
+
+    sWorkers.push(fn, userData, 1);
+  }
+
+  void parallelFor(size_t count, size_t grain, ParallelForFn fn, void* userData)
+  {
+    if (count == 0)
+      return;
+
+    if (grain == 0)
+      grain = 1;
+
+    size_t rangeCount = (count + grain - 1) / grain;
+    uint32_t workers = getWorkerCount();
+    uint32_t helpers = uint32_t(rangeCount - 1 < workers ? rangeCount - 1 : workers);
+
+    if (helpers == 0)
+    {
+      fn(0, count, userData);
+      return;
+    }
+
+    ParallelFor work;
+    work.fn = fn;
+    work.userData = userData;
+    work.count = count;
+    work.grain = grain;
+    work.next = 0;
+
+    sWorkers.push(parallelForJob, &work, helpers);
+
+    runParallelFor(work);
+
+    // helpers still in the queue (the workers are busy with something else) have nothing left to
+    // do; take them out rather than wait for them.
+    uint32_t started = helpers - sWorkers.cancel(&work);
+    for(uint32_t i=0;i < started;i++)
+      work.finished.wait();
+  }
+
+}
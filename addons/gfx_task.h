@@ -0,0 +1,61 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_TASK_H
+#define GFX_TASK_H
+
+#include "gfx.h"
+
+namespace GFX_NS
+{
+
+  // Worker threads shared by the addons. They are started the first time they are needed, one
+  // per core less the calling thread, and stopped by shutdownWorkers or at exit.
+
+  static const uint32_t kMaxWorkers = 31;
+
+  typedef void (*TaskFn)(void* userData);
+  typedef void (*ParallelForFn)(size_t begin, size_t end, void* userData);
+
+  // Changes the number of worker threads, restarting them if they are running. 0 runs everything
+  // on the calling thread.
+  void setWorkerCount(uint32_t count);
+
+  //
+  uint32_t getWorkerCount();
+
+  // Waits for queued work to finish and stops the worker threads.
+  void shutdownWorkers();
+
+  // Queues fn to run on a worker thread, in the order tasks were queued. With no workers, fn is
+  // called before runTask returns.
+  void runTask(TaskFn fn, void* userData);
+
+  // Calls fn for [0, count) in ranges of grain items, on the workers and the calling thread, and
+  // returns once all of them have been done. Ranges may run in any order and at the same time,
+  // so fn must only write to what its own range owns.
+  void parallelFor(size_t count, size_t grain, ParallelForFn fn, void* userData);
+
+}
+
+#endif
@@ -0,0 +1,372 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "gfx_texture.h"
+#include "gfx_hash.h"
+#include "gfx_mapped_file.h"
+#include <bx/readerwriter.h>
+#include <bx/uint32_t.h>
+
+namespace GFX_NS
+{
+
+  namespace
+  {
+    const uint8_t  kKtxIdentifier[12] = { 0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n' };
+    const uint32_t kKtxEndianness     = 0x04030201;
+    const uint32_t kKtxHeaderSize     = 64;
+
+    const uint32_t kDdsMagic          = BX_MAKEFOURCC('D', 'D', 'S', ' ');
+    const uint32_t kDdsDx10           = BX_MAKEFOURCC('D', 'X', '1', '0');
+    const uint32_t kDdsHeaderSize     = 128;
+    const uint32_t kDdsDx10HeaderSize = 20;
+    const uint32_t kDdsMipMapCount    = 0x20000;   // DDSD_MIPMAPCOUNT
+    const uint32_t kDdsDepth          = 0x800000;  // DDSD_DEPTH
+    const uint32_t kDdsPixelFourCC    = 0x4;       // DDPF_FOURCC
+    const uint32_t kDdsCubeMap        = 0x200;     // DDSCAPS2_CUBEMAP
+    const uint32_t kDdsDx10CubeMap    = 0x4;       // DDS_RESOURCE_MISC_TEXTURECUBE
+
+    uint32_t read32(const uint8_t* data, size_t offset)
+    {
+      uint32_t v;
+      memcpy(&v, data + offset, sizeof(v));
+      return v;
+    }
+
+    bool parseKtx(const uint8_t* data, size_t size, TextureHeader& header)
+    {
+      if (size < kKtxHeaderSize || memcmp(data, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0)
+        return false;
+
+      // files written on the other endianness would need every image swapped.
+      if (read32(data, 12) != kKtxEndianness)
+        return false;
+
+      uint32_t faces = read32(data, 52);
+
+      header.container  = TextureContainer::KTX;
+      header.format     = read32(data, 28);
+      header.width      = read32(data, 36);
+      header.height     = read32(data, 40);
+      header.depth      = read32(data, 44);
+      header.layerCount = read32(data, 48);
+      header.mipCount   = bx::uint32_max(read32(data, 56), 1);
+      header.cubeMap    = faces == 6;
+      header.dataOffset = kKtxHeaderSize + read32(data, 60);
+
+      return (faces == 1 || faces == 6) && header.width > 0;
+    }
+
+    bool parseDds(const uint8_t* data, size_t size, TextureHeader& header)
+    {
+      if (size < kDdsHeaderSize || read32(data, 0) != kDdsMagic || read32(data, 4) != kDdsHeaderSize - 4)
+        return false;
+
+      uint32_t flags = read32(data, 8);
+      uint32_t pixelFlags = read32(data, 80);
+      uint32_t fourCC = read32(data, 84);
+
+      header.container  = TextureContainer::DDS;
+      header.format     = (pixelFlags & kDdsPixelFourCC) != 0 ? fourCC : 0;
+      header.height     = read32(data, 12);
+      header.width      = read32(data, 16);
+      header.depth      = (flags & kDdsDepth) != 0 ? read32(data, 24) : 0;
+      header.layerCount = 0;
+      header.mipCount   = (flags & kDdsMipMapCount) != 0 ? bx::uint32_max(read32(data, 28), 1) : 1;
+      header.cubeMap    = (read32(data, 112) & kDdsCubeMap) != 0;
+      header.dataOffset = kDdsHeaderSize;
+
+      if (header.format == kDdsDx10)
+      {
+        if (size < kDdsHeaderSize + kDdsDx10HeaderSize)
+          return false;
+
+        uint32_t arraySize = read32(data, 140);
+
+        header.format     = read32(data, 128);
+        header.cubeMap    = (read32(data, 136) & kDdsDx10CubeMap) != 0;
+        header.layerCount = arraySize > 1 ? arraySize : 0;
+        header.dataOffset = kDdsHeaderSize + kDdsDx10HeaderSize;
+      }
+
+      return header.width > 0;
+    }
+
+    struct TextureEntry
+    {
+      uint64_t hash;
+      uint16_t next;       // in its bucket
+      bool     cached;
+      size_t   size;       // of the images
+      uint32_t refCount;
+      uint16_t lruPrev;    // among the textures nothing holds, oldest first
+      uint16_t lruNext;
+    };
+
+    // Entries are indexed by the texture handle's idx and keyed by the hash of their path and
+    // flags. Textures whose refCount is 0 are also on the lru list, from which they are evicted.
+    struct TextureCache
+    {
+      TextureCache()
+        : lruHead(kNoCacheEntry),
+          lruTail(kNoCacheEntry),
+          budget(kDefaultTextureBudget),
+          bytes(0),
+          unusedBytes(0),
+          count(0),
+          unusedCount(0),
+          evictions(0)
+      {
+      }
+
+      uint16_t find(uint64_t hash) const
+      {
+        return cache.find(hash);
+      }
+
+      void insert(uint16_t idx, uint64_t hash, size_t size)
+      {
+        TextureEntry& entry = cache.insert(idx, hash);
+        entry.size = size;
+        entry.refCount = 1;
+        entry.lruPrev = entry.lruNext = kNoCacheEntry;
+
+        bytes += size;
+        count++;
+      }
+
+      void remove(uint16_t idx)
+      {
+        cache.remove(idx);
+
+        bytes -= cache.entries[idx].size;
+        count--;
+      }
+
+      // nullptr if idx isn't in the cache.
+      TextureEntry* get(uint16_t idx)
+      {
+        return cache.get(idx);
+      }
+
+      void pushUnused(uint16_t idx)
+      {
+        TextureEntry& entry = cache.entries[idx];
+        entry.lruPrev = lruTail;
+        entry.lruNext = kNoCacheEntry;
+
+        if (lruTail != kNoCacheEntry)
+          cache.entries[lruTail].lruNext = idx;
+        else
+          lruHead = idx;
+        lruTail = idx;
+
+        unusedBytes += entry.size;
+        unusedCount++;
+      }
+
+      void removeUnused(uint16_t idx)
+      {
+        TextureEntry& entry = cache.entries[idx];
+
+        if (entry.lruPrev != kNoCacheEntry)
+          cache.entries[entry.lruPrev].lruNext = entry.lruNext;
+        else
+          lruHead = entry.lruNext;
+
+        if (entry.lruNext != kNoCacheEntry)
+          cache.entries[entry.lruNext].lruPrev = entry.lruPrev;
+        else
+          lruTail = entry.lruPrev;
+
+        entry.lruPrev = entry.lruNext = kNoCacheEntry;
+
+        unusedBytes -= entry.size;
+        unusedCount--;
+      }
+
+      // Destroys unused textures, oldest first, until the cache holds no more than limit bytes.
+      void evict(size_t limit)
+      {
+        while (bytes > limit && lruHead != kNoCacheEntry)
+        {
+          uint16_t idx = lruHead;
+          removeUnused(idx);
+          remove(idx);
+
+          bgfx::TextureHandle texture = { idx };
+          bgfx::destroyTexture(texture);
+          evictions++;
+        }
+      }
+
+      HashCache<TextureEntry>  cache;
+      uint16_t                 lruHead;
+      uint16_t                 lruTail;
+      size_t                   budget;
+      size_t                   bytes;
+      size_t                   unusedBytes;
+      uint32_t                 count;
+      uint32_t                 unusedCount;
+      uint32_t                 evictions;
+    };
+
+    TextureCache _textures;
+
+    uint64_t hashTexture(const char* path, uint32_t flags)
+    {
+      return hashBytes(hashString(kHashSeed, path), &flags, sizeof(flags));
+    }
+
+    bgfx::TextureHandle readTexture(bx::FileReaderI* reader, const char* path, uint32_t flags, size_t& size)
+    {
+      bgfx::TextureHandle texture = BGFX_INVALID_HANDLE;
+
+      if (bx::open(reader, path) != 0)
+        return texture;
+
+      uint32_t fileSize = (uint32_t) bx::getSize(reader);
+
+      uint8_t headerData[kMaxTextureHeaderSize];
+      uint32_t headerSize = bx::uint32_min(fileSize, kMaxTextureHeaderSize);
+      bx::read(reader, headerData, headerSize);
+
+      TextureHeader header;
+      if (parseTextureHeader(headerData, headerSize, header) && header.dataOffset <= fileSize)
+      {
+        // bgfx parses the container again and uploads its images as they are.
+        bx::seek(reader, 0, bx::Whence::Begin);
+        const bgfx::Memory* mem = bgfx::alloc(fileSize);
+        bx::read(reader, mem->data, fileSize);
+
+        texture = bgfx::createTexture(mem, flags);
+        size = fileSize - header.dataOffset;
+      }
+
+      bx::close(reader);
+      return texture;
+    }
+  }
+
+  bool parseTextureHeader(const void* data, size_t size, TextureHeader& header)
+  {
+    const uint8_t* bytes = (const uint8_t*) data;
+    return parseKtx(bytes, size, header) || parseDds(bytes, size, header);
+  }
+
+  bgfx::TextureHandle loadTexture(const char* path, uint32_t flags, bx::FileReaderI* reader, bx::AllocatorI* allocator)
+  {
+    uint64_t hash = hashTexture(path, flags);
+
+    bgfx::TextureHandle texture;
+    texture.idx = _textures.find(hash);
+
+    if (texture.idx != kNoCacheEntry)
+    {
+      TextureEntry& entry = _textures.cache.entries[texture.idx];
+      if (entry.refCount++ == 0)
+        _textures.removeUnused(texture.idx);
+      return texture;
+    }
+
+    if (allocator == nullptr)
+      allocator = getDefaultAllocator();
+
+    bool ownReader = false;
+
+#if GFX_CONFIG_MAPPED_FILE_READER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, MappedFileReader);
+      ownReader = true;
+    }
+#elif BX_CONFIG_CRT_FILE_READER_WRITER
+    if (reader == nullptr)
+    {
+      reader = BX_NEW(allocator, bx::CrtFileReader);
+      ownReader = true;
+    }
+#endif
+
+    size_t size = 0;
+    texture = readTexture(reader, path, flags, size);
+
+    if (texture.idx != bgfx::invalidHandle)
+    {
+      _textures.insert(texture.idx, hash, size);
+      _textures.evict(_textures.budget);
+    }
+
+#if GFX_CONFIG_MAPPED_FILE_READER || BX_CONFIG_CRT_FILE_READER_WRITER
+    if (ownReader)
+    {
+      BX_DELETE(allocator, reader);
+    }
+#endif
+
+    return texture;
+  }
+
+  void releaseTexture(bgfx::TextureHandle texture)
+  {
+    TextureEntry* entry = _textures.get(texture.idx);
+    if (entry == nullptr)
+    {
+      if (texture.idx != bgfx::invalidHandle)
+        bgfx::destroyTexture(texture);
+      return;
+    }
+
+    if (entry->refCount > 0 && --entry->refCount == 0)
+    {
+      _textures.pushUnused(texture.idx);
+      _textures.evict(_textures.budget);
+    }
+  }
+
+  void setTextureBudget(size_t bytes)
+  {
+    _textures.budget = bytes;
+    _textures.evict(bytes);
+  }
+
+  size_t getTextureBudget()
+  {
+    return _textures.budget;
+  }
+
+  void evictUnusedTextures()
+  {
+    _textures.evict(0);
+  }
+
+  void getTextureCacheStats(TextureCacheStats& stats)
+  {
+    stats.bytes = _textures.bytes;
+    stats.unusedBytes = _textures.unusedBytes;
+    stats.count = _textures.count;
+    stats.unusedCount = _textures.unusedCount;
+    stats.evictions = _textures.evictions;
+  }
+
+}
@@ -0,0 +1,104 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef GFX_TEXTURE_H
+#define GFX_TEXTURE_H
+
+#include "gfx.h"
+
+namespace bx
+{
+  struct FileReaderI;
+}
+
+namespace GFX_NS
+{
+
+  enum class TextureContainer : uint8_t
+  {
+    KTX,
+    DDS
+  };
+
+  // What a KTX or DDS file holds, from its header. format is the container's own; the GL
+  // internal format for KTX, and the FourCC, or the DXGI format of a DX10 header, for DDS.
+  struct TextureHeader
+  {
+    TextureContainer container;
+    uint32_t         format;
+    uint32_t         width;
+    uint32_t         height;
+    uint32_t         depth;       // 0 unless it is a volume
+    uint32_t         layerCount;  // 0 unless it is an array
+    uint32_t         mipCount;
+    bool             cubeMap;
+    uint32_t         dataOffset;  // where the images start
+  };
+
+  // Enough of a file for parseTextureHeader; the largest header is a DDS with a DX10 header.
+  static const uint32_t kMaxTextureHeaderSize = 148;
+
+  // Returns false if data isn't the start of a KTX or DDS file that this platform can read.
+  bool parseTextureHeader(const void* data, size_t size, TextureHeader& header);
+
+  // Textures are cached by path and flags, like loadProgram's programs, so loading a texture
+  // again is a lookup. Each loadTexture is matched by a releaseTexture. The file is handed to
+  // bgfx as it is, which uploads its images without decoding them; only its header is read
+  // here, to check it and to count its images against the texture budget. The reader, when
+  // one is made, comes from _allocator, or getDefaultAllocator() if it is nullptr. Returns an
+  // invalid handle if the file can't be read or isn't a KTX or DDS.
+  bgfx::TextureHandle loadTexture(const char* path, uint32_t flags = BGFX_TEXTURE_NONE, bx::FileReaderI* _reader = nullptr, bx::AllocatorI* _allocator = nullptr);
+
+  // Once every loadTexture of it is released, the texture stays cached, and is only destroyed
+  // when the cache is over budget. Textures that didn't come from loadTexture are destroyed.
+  void releaseTexture(bgfx::TextureHandle texture);
+
+  // The cache is kept under budget bytes of images by destroying the textures that nothing
+  // holds, least recently released first. Textures still held are never destroyed, so it can
+  // go over while they are.
+  static const size_t kDefaultTextureBudget = 256 * 1024 * 1024;
+
+  // Evicts straight away if the cache is now over.
+  void setTextureBudget(size_t bytes);
+
+  //
+  size_t getTextureBudget();
+
+  // Destroys every cached texture that nothing holds.
+  void evictUnusedTextures();
+
+  struct TextureCacheStats
+  {
+    size_t   bytes;          // of every cached texture
+    size_t   unusedBytes;    // of those nothing holds
+    uint32_t count;
+    uint32_t unusedCount;
+    uint32_t evictions;      // since the start
+  };
+
+  //
+  void getTextureCacheStats(TextureCacheStats& stats);
+
+}
+
+#endif
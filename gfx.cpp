@@ -21,12 +21,230 @@
 // SOFTWARE.
 
 #include "gfx.h"
+#include "gfx_hash.h"
+
+#include <bx/mutex.h>
+#include <bx/uint32_t.h>
 
 namespace GFX_NS
 {
   namespace
   {
     Context* _ctx;
+
+    bx::CrtAllocator _crtAllocator;
+    bx::AllocatorI*  _allocator = &_crtAllocator;
+
+    size_t alignUp(size_t value, size_t align)
+    {
+      return (value + align - 1) & ~(align - 1);
+    }
+
+    const size_t kDefaultFrameArenaBlockSize = 256 * 1024;
+
+    // One thread's arenas, one per frame in flight.
+    struct FrameArena
+    {
+      FrameArena*      next;
+      LinearAllocator* allocators[GFX_FRAME_ARENA_COUNT];
+    };
+
+    struct FrameArenas
+    {
+      FrameArenas()
+        : arenas(nullptr),
+          index(0),
+          blockSize(kDefaultFrameArenaBlockSize),
+          lastFrameUsed(0),
+          highWater(0),
+          threadCount(0)
+      {
+      }
+
+      ~FrameArenas()
+      {
+        while (arenas != nullptr)
+        {
+          FrameArena* next = arenas->next;
+          for(uint32_t i=0;i < GFX_FRAME_ARENA_COUNT;i++)
+            BX_DELETE(&_crtAllocator, arenas->allocators[i]);
+          BX_DELETE(&_crtAllocator, arenas);
+          arenas = next;
+        }
+      }
+
+      size_t getUsed() const
+      {
+        size_t total = 0;
+        for(FrameArena* arena = arenas;arena != nullptr;arena = arena->next)
+          total += arena->allocators[index]->getUsed();
+        return total;
+      }
+
+      bx::Mutex   mutex;      // held while a thread adds its arena
+      FrameArena* arenas;
+      uint32_t    index;      // of the current frame's allocator in each arena
+      size_t      blockSize;
+      size_t      lastFrameUsed;
+      size_t      highWater;
+      uint32_t    threadCount;
+    };
+
+    FrameArenas _frameArenas;
+    thread_local FrameArena* _threadFrameArena;
+
+    FrameArena* getThreadFrameArena()
+    {
+      if (_threadFrameArena == nullptr)
+      {
+        // blocks come from the crt, as the default allocator needn't be thread safe.
+        FrameArena* arena = BX_NEW(&_crtAllocator, FrameArena);
+
+        bx::MutexScope lock(_frameArenas.mutex);
+
+        for(uint32_t i=0;i < GFX_FRAME_ARENA_COUNT;i++)
+          arena->allocators[i] = BX_NEW(&_crtAllocator, LinearAllocator)(_frameArenas.blockSize, &_crtAllocator);
+
+        arena->next = _frameArenas.arenas;
+        _frameArenas.arenas = arena;
+        _frameArenas.threadCount++;
+
+        _threadFrameArena = arena;
+      }
+
+      return _threadFrameArena;
+    }
+
+    struct PendingFree
+    {
+      bx::AllocatorI* allocator;
+      void*           ptr;
+    };
+
+    // queued by freeOnFrame, from any thread.
+    struct PendingFrees
+    {
+      bx::Mutex               mutex;
+      GFX_VECTOR<PendingFree> frees;
+    };
+
+    PendingFrees _pendingFrees;
+
+    void freePending()
+    {
+      GFX_VECTOR<PendingFree> frees;
+      {
+        bx::MutexScope lock(_pendingFrees.mutex);
+        frees.swap(_pendingFrees.frees);
+      }
+
+      for(size_t i=0;i < frees.size();i++)
+        BX_FREE(frees[i].allocator, frees[i].ptr);
+    }
+
+    // used for lod selection until setViewRect is called for the view.
+    const uint16_t kDefaultViewHeight = 720;
+
+    struct PooledProgram
+    {
+      bgfx::ProgramHandle program;
+      ReleaseProgramFn    release;
+    };
+
+    struct PooledMesh
+    {
+      MeshRange           range;
+      bool                owned;     // whether the pool destroys its buffers
+    };
+
+    // bgfx resources of destroyed ids, waiting for the frames that may use them to be rendered.
+    struct PendingDestroy
+    {
+      uint32_t            frame;     // destroyed once _frameCount reaches it
+      MeshRange           mesh;
+      PooledProgram       program;
+    };
+
+    HandlePool<PooledMesh, MeshId>        _meshes;
+    HandlePool<PooledProgram, ProgramId>  _programs;
+    HandlePool<Material, MaterialId>      _materials;
+    GFX_VECTOR<PendingDestroy>            _pendingDestroys;
+    uint32_t                              _frameCount;
+
+    void deferDestroy(const MeshRange& mesh, const PooledProgram& program)
+    {
+      PendingDestroy pending;
+      pending.frame = _frameCount + GFX_FRAME_ARENA_COUNT;
+      pending.mesh = mesh;
+      pending.program = program;
+      _pendingDestroys.push_back(pending);
+    }
+
+    void destroyPending()
+    {
+      size_t kept = 0;
+      for(size_t i=0;i < _pendingDestroys.size();i++)
+      {
+        const PendingDestroy& pending = _pendingDestroys[i];
+
+        // still in a frame that may not have been rendered.
+        if (pending.frame > _frameCount)
+        {
+          _pendingDestroys[kept++] = pending;
+          continue;
+        }
+
+        if (pending.mesh.vertexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyVertexBuffer(pending.mesh.vertexBuffer);
+        if (pending.mesh.indexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyIndexBuffer(pending.mesh.indexBuffer);
+        if (pending.mesh.dynamicVertexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyDynamicVertexBuffer(pending.mesh.dynamicVertexBuffer);
+        if (pending.mesh.dynamicIndexBuffer.idx != bgfx::invalidHandle)
+          bgfx::destroyDynamicIndexBuffer(pending.mesh.dynamicIndexBuffer);
+
+        if (pending.program.program.idx != bgfx::invalidHandle)
+        {
+          if (pending.program.release != nullptr)
+            pending.program.release(pending.program.program);
+          else
+            bgfx::destroyProgram(pending.program.program);
+        }
+      }
+
+      _pendingDestroys.resize(kept);
+    }
+
+    // field by field, so padding isn't hashed.
+    void hashMaterial(Material& material)
+    {
+      uint64_t hash = kHashSeed;
+      hash = hashBytes(hash, &material.program.idx, sizeof(material.program.idx));
+      hash = hashBytes(hash, &material.state.value, sizeof(material.state.value));
+
+      for(uint32_t i=0;i < material.textureCount;i++)
+      {
+        const MaterialTexture& texture = material.textures[i];
+        hash = hashBytes(hash, &texture.stage, sizeof(texture.stage));
+        hash = hashBytes(hash, &texture.sampler.idx, sizeof(texture.sampler.idx));
+        hash = hashBytes(hash, &texture.texture.idx, sizeof(texture.texture.idx));
+        hash = hashBytes(hash, &texture.flags, sizeof(texture.flags));
+      }
+
+      for(uint32_t i=0;i < material.uniformCount;i++)
+      {
+        const MaterialUniform& uniform = material.uniforms[i];
+        hash = hashBytes(hash, &uniform.uniform.idx, sizeof(uniform.uniform.idx));
+        hash = hashBytes(hash, &uniform.num, sizeof(uniform.num));
+      }
+
+      hash = hashBytes(hash, material.block, sizeof(float) * material.floatCount);
+
+      material.hash = hash;
+
+      // submit takes a signed depth, so 31 bits of it.
+      material.sortId = uint32_t(hash >> 33);
+    }
   }
 
   const State State::DEFAULT = State(BGFX_STATE_DEFAULT);
@@ -40,8 +258,16 @@ namespace GFX_NS
   const Vector Vector::PosZ(0,0,1,0);
   const Vector Vector::NegZ(0,0,-1,0);
 
-  Context::Context()
+  Context::Context(bx::AllocatorI* _allocator)
   {
+    allocator = _allocator != nullptr ? _allocator : getDefaultAllocator();
+
+    model.setAllocator(allocator);
+    view.setAllocator(allocator);
+    projection.setAllocator(allocator);
+    state.setAllocator(allocator);
+    views.setAllocator(allocator);
+
     view.push_back(Matrix());
     projection.push_back(Matrix());
     model.push_back(Matrix());
@@ -57,6 +283,15 @@ namespace GFX_NS
     lastViewVersion = 0;
     lastProjectionVersion = 0;
     lastStateVersion = 0;
+
+    initMaterial(material, BGFX_INVALID_HANDLE);
+    hasMaterial = false;
+    boundMaterialHash = 0;
+    hasBoundMaterial = false;
+
+    memset(viewHeights, 0, sizeof(viewHeights));
+    lodThreshold = 1.0f;
+    lodHysteresis = 0.25f;
   }
 
   Context::~Context()
@@ -76,6 +311,251 @@ namespace GFX_NS
 //  {
 //  }
 
+  void setDefaultAllocator(bx::AllocatorI* allocator)
+  {
+    _allocator = allocator != nullptr ? allocator : &_crtAllocator;
+  }
+
+  bx::AllocatorI* getDefaultAllocator()
+  {
+    return _allocator;
+  }
+
+  LinearAllocator::LinearAllocator(size_t _blockSize, bx::AllocatorI* _parent)
+    : parent(_parent != nullptr ? _parent : getDefaultAllocator()),
+      blocks(nullptr),
+      top(nullptr),
+      end(nullptr),
+      last(nullptr),
+      blockSize(_blockSize),
+      used(0),
+      highWater(0),
+      fixed(false)
+  {
+  }
+
+  LinearAllocator::LinearAllocator(void* memory, size_t size)
+    : parent(nullptr),
+      blocks(nullptr),
+      top((uint8_t*) memory),
+      end((uint8_t*) memory + size),
+      last(nullptr),
+      blockSize(size),
+      used(0),
+      highWater(0),
+      fixed(true)
+  {
+  }
+
+  LinearAllocator::~LinearAllocator()
+  {
+    reset();
+
+    if (blocks != nullptr)
+      BX_FREE(parent, blocks);
+  }
+
+  void LinearAllocator::reset()
+  {
+    if (blocks != nullptr && blocks->next != nullptr)
+    {
+      // it outgrew its first block, so all of them go and the next is made big enough for
+      // everything; a load that is the same every frame then settles into a single block.
+      size_t needed = sizeof(Block) + used + used / 8;
+      blockSize = needed > blockSize ? needed : blockSize;
+
+      while (blocks != nullptr)
+      {
+        Block* next = blocks->next;
+        BX_FREE(parent, blocks);
+        blocks = next;
+      }
+
+      top = nullptr;
+      end = nullptr;
+    }
+
+    if (blocks != nullptr)
+    {
+      top = (uint8_t*) (blocks + 1);
+      end = (uint8_t*) blocks + blocks->size;
+    }
+    else if (fixed)
+    {
+      top = end - blockSize;
+    }
+
+    last = nullptr;
+    used = 0;
+  }
+
+  void* LinearAllocator::allocate(size_t size, size_t align)
+  {
+    // each allocation has its size just before it, for realloc.
+    align = align > sizeof(size_t) ? align : sizeof(size_t);
+    uint8_t* ptr = (uint8_t*) alignUp(size_t(top) + sizeof(size_t), align);
+
+    if (top == nullptr || ptr + size > end)
+    {
+      if (fixed)
+        return nullptr;
+
+      size_t needed = sizeof(Block) + sizeof(size_t) + align + size;
+      size_t newSize = needed > blockSize ? needed : blockSize;
+
+      Block* block = (Block*) BX_ALLOC(parent, newSize);
+      if (block == nullptr)
+        return nullptr;
+
+      block->next = blocks;
+      block->size = newSize;
+      blocks = block;
+
+      top = (uint8_t*) (block + 1);
+      end = (uint8_t*) block + newSize;
+      ptr = (uint8_t*) alignUp(size_t(top) + sizeof(size_t), align);
+    }
+
+    ((size_t*) ptr)[-1] = size;
+    used += (ptr + size) - top;
+    highWater = used > highWater ? used : highWater;
+    top = ptr + size;
+    last = ptr;
+    return ptr;
+  }
+
+  void* LinearAllocator::realloc(void* ptr, size_t size, size_t align, const char* /*file*/, uint32_t /*line*/)
+  {
+    if (size == 0)
+    {
+      // only the last allocation can be given back.
+      if (ptr != nullptr && ptr == last)
+      {
+        size_t oldSize = ((size_t*) ptr)[-1];
+        used -= oldSize;
+        top -= oldSize;
+        last = nullptr;
+      }
+      return nullptr;
+    }
+
+    if (ptr == nullptr)
+      return allocate(size, align);
+
+    size_t oldSize = ((size_t*) ptr)[-1];
+
+    if (ptr == last && (uint8_t*) ptr + size <= end)
+    {
+      used = used - oldSize + size;
+      highWater = used > highWater ? used : highWater;
+      top = (uint8_t*) ptr + size;
+      ((size_t*) ptr)[-1] = size;
+      return ptr;
+    }
+
+    void* newPtr = allocate(size, align);
+    if (newPtr != nullptr)
+      memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+    return newPtr;
+  }
+
+  PoolAllocator::PoolAllocator(size_t _itemSize, size_t _itemsPerBlock, bx::AllocatorI* _parent)
+    : parent(_parent != nullptr ? _parent : getDefaultAllocator()),
+      blocks(nullptr),
+      freeList(nullptr),
+      itemSize(alignUp(_itemSize > sizeof(void*) ? _itemSize : sizeof(void*), BX_CONFIG_ALLOCATOR_NATURAL_ALIGNMENT)),
+      itemsPerBlock(_itemsPerBlock > 0 ? _itemsPerBlock : 1),
+      used(0)
+  {
+  }
+
+  PoolAllocator::~PoolAllocator()
+  {
+    while (blocks != nullptr)
+    {
+      Block* next = blocks->next;
+      BX_FREE(parent, blocks);
+      blocks = next;
+    }
+  }
+
+  bool PoolAllocator::owns(const void* ptr) const
+  {
+    for(const Block* block=blocks;block != nullptr;block = block->next)
+    {
+      const uint8_t* first = (const uint8_t*) block + alignUp(sizeof(Block), BX_CONFIG_ALLOCATOR_NATURAL_ALIGNMENT);
+      if (ptr >= first && ptr < first + itemSize * itemsPerBlock)
+        return true;
+    }
+    return false;
+  }
+
+  void* PoolAllocator::realloc(void* ptr, size_t size, size_t align, const char* file, uint32_t line)
+  {
+    bool fits = size <= itemSize && align <= BX_CONFIG_ALLOCATOR_NATURAL_ALIGNMENT;
+    bool pooled = ptr != nullptr && owns(ptr);
+
+    if (ptr != nullptr && pooled == false)
+    {
+      // came from the parent.
+      return parent->realloc(ptr, size, align, file, line);
+    }
+
+    if (size == 0)
+    {
+      if (pooled)
+      {
+        *(void**) ptr = freeList;
+        freeList = ptr;
+        used--;
+      }
+      return nullptr;
+    }
+
+    if (pooled && fits)
+      return ptr;
+
+    void* newPtr;
+
+    if (fits)
+    {
+      if (freeList == nullptr)
+      {
+        size_t header = alignUp(sizeof(Block), BX_CONFIG_ALLOCATOR_NATURAL_ALIGNMENT);
+        Block* block = (Block*) BX_ALLOC(parent, header + itemSize * itemsPerBlock);
+        if (block == nullptr)
+          return nullptr;
+
+        block->next = blocks;
+        blocks = block;
+
+        uint8_t* first = (uint8_t*) block + header;
+        for(size_t i=0;i < itemsPerBlock;i++)
+        {
+          void* item = first + i * itemSize;
+          *(void**) item = freeList;
+          freeList = item;
+        }
+      }
+
+      newPtr = freeList;
+      freeList = *(void**) newPtr;
+      used++;
+    }
+    else
+    {
+      newPtr = parent->realloc(nullptr, size, align, file, line);
+    }
+
+    if (pooled && newPtr != nullptr)
+    {
+      memcpy(newPtr, ptr, itemSize < size ? itemSize : size);
+      realloc(ptr, 0, 0, file, line);
+    }
+
+    return newPtr;
+  }
+
   void setContext(Context* ctx)
   {
     _ctx = ctx;
@@ -118,6 +598,11 @@ namespace GFX_NS
 
   void setViewRect(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
   {
+    // it may be called while setting up, before there is a context.
+    auto ctx = getContext();
+    if (ctx != nullptr)
+      ctx->viewHeights[id] = h;
+
     bgfx::setViewRect(id, x, y, w, h);
   }
 
@@ -130,6 +615,7 @@ namespace GFX_NS
   {
     auto ctx = getContext();
     ctx->currentProgram = program;
+    ctx->hasMaterial = false;
   }
 
   void setMatrices(const Camera& camera, const Matrix& model)
@@ -359,17 +845,255 @@ namespace GFX_NS
     return ctx->state.back();
   }
 
+  void initMaterial(Material& material, bgfx::ProgramHandle program, State state)
+  {
+    material.program = program;
+    material.state = state;
+    material.textureCount = 0;
+    material.uniformCount = 0;
+    material.floatCount = 0;
+    hashMaterial(material);
+  }
+
+  bool addMaterialTexture(Material& material, uint8_t stage, bgfx::UniformHandle sampler, bgfx::TextureHandle texture, uint32_t flags)
+  {
+    if (material.textureCount == kMaxMaterialTextures)
+      return false;
+
+    MaterialTexture& slot = material.textures[material.textureCount++];
+    slot.stage = stage;
+    slot.sampler = sampler;
+    slot.texture = texture;
+    slot.flags = flags;
+
+    hashMaterial(material);
+    return true;
+  }
+
+  bool addMaterialUniform(Material& material, bgfx::UniformHandle uniform, bgfx::UniformType::Enum type, const float* value, uint16_t num)
+  {
+    uint32_t floats;
+    switch(type)
+    {
+      case bgfx::UniformType::Vec4: floats = 4;  break;
+      case bgfx::UniformType::Mat3: floats = 9;  break;
+      case bgfx::UniformType::Mat4: floats = 16; break;
+      default:                      return false;
+    }
+
+    uint32_t size = floats * num;
+    if (material.uniformCount == kMaxMaterialUniforms || material.floatCount + size > kMaxMaterialFloats)
+      return false;
+
+    MaterialUniform& slot = material.uniforms[material.uniformCount++];
+    slot.uniform = uniform;
+    slot.num = num;
+    slot.offset = material.floatCount;
+    slot.size = uint16_t(size);
+
+    memcpy(&material.block[slot.offset], value, sizeof(float) * size);
+    material.floatCount += uint16_t(size);
+
+    hashMaterial(material);
+    return true;
+  }
+
+  void setMaterial(const Material& material)
+  {
+    auto ctx = getContext();
+    ctx->material = material;
+    ctx->hasMaterial = true;
+  }
+
+  void clearMaterial()
+  {
+    auto ctx = getContext();
+    ctx->hasMaterial = false;
+  }
+
+  MeshId addMesh(const Mesh& mesh)
+  {
+    return addMesh(makeMeshRange(mesh), true);
+  }
+
+  MeshId addMesh(const MeshRange& range, bool owned)
+  {
+    PooledMesh pooled = { range, owned };
+    return _meshes.create(pooled);
+  }
+
+  const MeshRange* getMesh(MeshId id)
+  {
+    const PooledMesh* pooled = _meshes.get(id);
+    return pooled != nullptr ? &pooled->range : nullptr;
+  }
+
+  void destroyMesh(MeshId id)
+  {
+    PooledMesh pooled;
+    if (_meshes.destroy(id, pooled) && pooled.owned)
+    {
+      PooledProgram none = { BGFX_INVALID_HANDLE, nullptr };
+      deferDestroy(pooled.range, none);
+    }
+  }
+
+  ProgramId addProgram(bgfx::ProgramHandle program, ReleaseProgramFn release)
+  {
+    PooledProgram pooled = { program, release };
+    return _programs.create(pooled);
+  }
+
+  bgfx::ProgramHandle getProgram(ProgramId id)
+  {
+    const PooledProgram* pooled = _programs.get(id);
+    if (pooled == nullptr)
+    {
+      bgfx::ProgramHandle invalid = BGFX_INVALID_HANDLE;
+      return invalid;
+    }
+
+    return pooled->program;
+  }
+
+  void destroyProgram(ProgramId id)
+  {
+    PooledProgram program;
+    if (_programs.destroy(id, program))
+    {
+      Mesh none = { BGFX_INVALID_HANDLE, BGFX_INVALID_HANDLE };
+      deferDestroy(makeMeshRange(none), program);
+    }
+  }
+
+  MaterialId addMaterial(const Material& material)
+  {
+    return _materials.create(material);
+  }
+
+  const Material* getMaterial(MaterialId id)
+  {
+    return _materials.get(id);
+  }
+
+  void destroyMaterial(MaterialId id)
+  {
+    Material material;
+    _materials.destroy(id, material);
+  }
+
+  void draw(MeshId id)
+  {
+    const PooledMesh* pooled = _meshes.get(id);
+    if (pooled != nullptr)
+      draw(pooled->range);
+  }
+
+  void setProgram(ProgramId id)
+  {
+    setProgram(getProgram(id));
+  }
+
+  void setMaterial(MaterialId id)
+  {
+    const Material* material = _materials.get(id);
+    if (material != nullptr)
+      setMaterial(*material);
+    else
+      clearMaterial();
+  }
+
+  void getHandlePoolStats(HandlePoolStats& stats)
+  {
+    stats.meshes = _meshes.size();
+    stats.programs = _programs.size();
+    stats.materials = _materials.size();
+    stats.pendingDestroys = uint32_t(_pendingDestroys.size());
+  }
+
+  void setLodThreshold(float pixels, float hysteresis)
+  {
+    auto ctx = getContext();
+    ctx->lodThreshold = pixels;
+    ctx->lodHysteresis = hysteresis;
+  }
+
+  uint8_t selectLod(const LodMesh& mesh)
+  {
+    auto ctx = getContext();
+
+    if (mesh.lodCount <= 1)
+      return 0;
+
+    Matrix modelView = ctx->model.back() * ctx->view.back();
+    const Matrix& projection = ctx->projection.back();
+
+    float centre[3];
+    bx::vec3MulMtx(centre, mesh.centre, modelView.ptr());
+
+    // largest axis scale of the model and view transform.
+    float scale = 0.0f;
+    for(size_t i=0;i < 3;i++)
+      scale = bx::fmax(scale, bx::vec3Length(&modelView.e[i * 4]));
+
+    uint16_t height = ctx->viewHeights[ctx->views.back()];
+    if (height == 0)
+      height = kDefaultViewHeight;
+
+    // pixels per model unit at the nearest point of the bounding sphere.
+    float distance = bx::fmax(centre[2] - mesh.radius * scale, 1e-4f);
+    float pixelsPerUnit = scale * projection.m[1][1] * 0.5f * float(height) / distance;
+
+    uint8_t current = bx::uint32_min(mesh.currentLod, mesh.lodCount - 1);
+    float   coarsenThreshold = ctx->lodThreshold * (1.0f - ctx->lodHysteresis);
+
+    if (mesh.lods[current].error * pixelsPerUnit > ctx->lodThreshold)
+    {
+      // too coarse; step back to the coarsest level that fits.
+      while (current > 0 && mesh.lods[current].error * pixelsPerUnit > ctx->lodThreshold)
+        current--;
+    }
+    else
+    {
+      while (current + 1 < mesh.lodCount && mesh.lods[current + 1].error * pixelsPerUnit <= coarsenThreshold)
+        current++;
+    }
+
+    return current;
+  }
+
   void draw(const Mesh& mesh)
   {
     draw(mesh.vertexBuffer, mesh.indexBuffer);
   }
 
+  void draw(LodMesh& mesh)
+  {
+    mesh.currentLod = selectLod(mesh);
+    const MeshLod& lod = mesh.lods[mesh.currentLod];
+    draw(mesh.vertexBuffer, mesh.indexBuffer, lod.firstIndex, lod.indexCount);
+  }
+
   void draw(const bgfx::VertexBufferHandle& vertexBuffer)
   {
     draw(vertexBuffer, BGFX_INVALID_HANDLE);
   }
 
   void draw(const bgfx::VertexBufferHandle& vertexBuffer, const bgfx::IndexBufferHandle& indexBuffer)
+  {
+    draw(vertexBuffer, indexBuffer, 0, UINT32_MAX);
+  }
+
+  void draw(const bgfx::VertexBufferHandle& vertexBuffer, const bgfx::IndexBufferHandle& indexBuffer, uint32_t firstIndex, uint32_t indexCount)
+  {
+    Mesh mesh = { vertexBuffer, indexBuffer };
+    MeshRange range = makeMeshRange(mesh);
+    range.firstIndex = firstIndex;
+    range.indexCount = indexCount;
+    draw(range);
+  }
+
+  void draw(const MeshRange& mesh)
   {
     auto ctx = getContext();
     
@@ -388,24 +1112,70 @@ namespace GFX_NS
       bgfx::setTransform(m.ptr());
     }
 
-    if (ctx->stateVersion != ctx->lastStateVersion)
+    if (ctx->hasMaterial)
+    {
+      const Material& material = ctx->material;
+
+      // bgfx applies uniforms in its sorted order, not the order they were set in, so only a
+      // draw of the same material straight after, which sorts next to it, can rely on what the
+      // last draw uploaded; any other material uploads all of its uniforms.
+      if (ctx->hasBoundMaterial == false || ctx->boundMaterialHash != material.hash)
+      {
+        for(uint32_t i=0;i < material.uniformCount;i++)
+        {
+          const MaterialUniform& uniform = material.uniforms[i];
+          bgfx::setUniform(uniform.uniform, &material.block[uniform.offset], uniform.num);
+        }
+
+        ctx->boundMaterialHash = material.hash;
+        ctx->hasBoundMaterial = true;
+      }
+
+      // textures and state don't outlive a draw in bgfx.
+      for(uint32_t i=0;i < material.textureCount;i++)
+      {
+        const MaterialTexture& texture = material.textures[i];
+        bgfx::setTexture(texture.stage, texture.sampler, texture.texture, texture.flags);
+      }
+
+      bgfx::setState(material.state.value);
+    }
+    else if (ctx->stateVersion != ctx->lastStateVersion)
     {
       State state = ctx->state.back();
       
       bgfx::setState(state.value);
     }
 
-    if (vertexBuffer.idx != bgfx::invalidHandle)
+    // the vertex range's start is the base vertex of the indexed draw.
+    if (mesh.dynamicVertexBuffer.idx != bgfx::invalidHandle)
     {
-      bgfx::setVertexBuffer(vertexBuffer);
+      bgfx::setVertexBuffer(mesh.dynamicVertexBuffer, mesh.firstVertex, mesh.vertexCount);
+    }
+    else if (mesh.vertexBuffer.idx != bgfx::invalidHandle)
+    {
+      if (mesh.firstVertex == 0 && mesh.vertexCount == UINT32_MAX)
+        bgfx::setVertexBuffer(mesh.vertexBuffer);
+      else
+        bgfx::setVertexBuffer(mesh.vertexBuffer, mesh.firstVertex, mesh.vertexCount);
     }
 
-    if (indexBuffer.idx != bgfx::invalidHandle)
+    if (mesh.dynamicIndexBuffer.idx != bgfx::invalidHandle)
     {
-      bgfx::setIndexBuffer(indexBuffer);
+      bgfx::setIndexBuffer(mesh.dynamicIndexBuffer, mesh.firstIndex, mesh.indexCount);
+    }
+    else if (mesh.indexBuffer.idx != bgfx::invalidHandle)
+    {
+      if (mesh.firstIndex == 0 && mesh.indexCount == UINT32_MAX)
+        bgfx::setIndexBuffer(mesh.indexBuffer);
+      else
+        bgfx::setIndexBuffer(mesh.indexBuffer, mesh.firstIndex, mesh.indexCount);
     }
 
-    bgfx::submit(0, ctx->currentProgram);
+    if (ctx->hasMaterial)
+      bgfx::submit(0, ctx->material.program, int32_t(ctx->material.sortId));
+    else
+      bgfx::submit(0, ctx->currentProgram);
 
     ctx->projectionVersion = ctx->lastProjectionVersion;
     ctx->viewVersion = ctx->lastViewVersion;
@@ -413,8 +1183,77 @@ namespace GFX_NS
 
   }
 
+  bx::AllocatorI* getFrameAllocator()
+  {
+    return getThreadFrameArena()->allocators[_frameArenas.index];
+  }
+
+  void* frameAlloc(size_t size, size_t align)
+  {
+    return BX_ALIGNED_ALLOC(getFrameAllocator(), size, align);
+  }
+
+  void getFrameArenaStats(FrameArenaStats& stats)
+  {
+    bx::MutexScope lock(_frameArenas.mutex);
+
+    stats.used = _frameArenas.getUsed();
+    stats.lastFrameUsed = _frameArenas.lastFrameUsed;
+    stats.highWater = stats.used > _frameArenas.highWater ? stats.used : _frameArenas.highWater;
+    stats.threadCount = _frameArenas.threadCount;
+  }
+
+  void setFrameArenaBlockSize(size_t size)
+  {
+    bx::MutexScope lock(_frameArenas.mutex);
+    _frameArenas.blockSize = size;
+  }
+
+  void freeOnFrame(bx::AllocatorI* allocator, void* ptr)
+  {
+    if (ptr == nullptr)
+      return;
+
+    PendingFree pending = { allocator, ptr };
+
+    bx::MutexScope lock(_pendingFrees.mutex);
+    _pendingFrees.frees.push_back(pending);
+  }
+
+  void releaseOnFrame(void* ptr, void* userData)
+  {
+    freeOnFrame((bx::AllocatorI*) userData, ptr);
+  }
+
+  uint32_t getFrameCount()
+  {
+    return _frameCount;
+  }
+
   void frame()
   {
     bgfx::frame();
+
+    freePending();
+
+    // uniforms are uploaded again in the next frame, rather than relying on bgfx keeping them.
+    auto ctx = getContext();
+    if (ctx != nullptr)
+      ctx->hasBoundMaterial = false;
+
+    _frameCount++;
+    destroyPending();
+
+    // bgfx has finished with the frame before last now, so its arenas can be reused.
+    bx::MutexScope lock(_frameArenas.mutex);
+
+    size_t used = _frameArenas.getUsed();
+    _frameArenas.lastFrameUsed = used;
+    _frameArenas.highWater = used > _frameArenas.highWater ? used : _frameArenas.highWater;
+
+    _frameArenas.index = (_frameArenas.index + 1) % GFX_FRAME_ARENA_COUNT;
+
+    for(FrameArena* arena = _frameArenas.arenas;arena != nullptr;arena = arena->next)
+      arena->allocators[_frameArenas.index]->reset();
   }
 }
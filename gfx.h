@@ -26,6 +26,7 @@
 #define GFX_NS gfx
 
 #include <bgfx/bgfx.h>
+#include <bx/allocator.h>
 #include <bx/fpumath.h>
 #if BGFX_CONFIG_USE_TINYSTL
 # include <tinystl/vector.h>
@@ -247,6 +248,60 @@ namespace GFX_NS
     bgfx::IndexBufferHandle  indexBuffer;
   };
 
+  // Part of a mesh's buffers, or a range of buffers it shares with other meshes, as in a
+  // GeometryArena. Indices count from firstVertex, so meshes sharing a buffer keep 16 bit
+  // indices. A range of dynamic buffers has those handles set and the static ones invalid.
+  struct MeshRange
+  {
+    bgfx::VertexBufferHandle        vertexBuffer;
+    bgfx::IndexBufferHandle         indexBuffer;
+    bgfx::DynamicVertexBufferHandle dynamicVertexBuffer;
+    bgfx::DynamicIndexBufferHandle  dynamicIndexBuffer;
+    uint32_t                        firstVertex;
+    uint32_t                        vertexCount;   // UINT32_MAX for all of them
+    uint32_t                        firstIndex;
+    uint32_t                        indexCount;    // UINT32_MAX for all of them
+  };
+
+  // All of mesh's buffers.
+  inline MeshRange makeMeshRange(const Mesh& mesh)
+  {
+    MeshRange range;
+    range.vertexBuffer = mesh.vertexBuffer;
+    range.indexBuffer = mesh.indexBuffer;
+    range.dynamicVertexBuffer.idx = bgfx::invalidHandle;
+    range.dynamicIndexBuffer.idx = bgfx::invalidHandle;
+    range.firstVertex = 0;
+    range.vertexCount = UINT32_MAX;
+    range.firstIndex = 0;
+    range.indexCount = UINT32_MAX;
+    return range;
+  }
+
+  static const uint8_t kMaxMeshLods = 8;
+
+  struct MeshLod
+  {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    error;      // worst deviation from the original surface, in model units
+  };
+
+  // A mesh with a chain of levels of detail in one vertex and one index buffer, finest first.
+  // draw() picks the coarsest level whose error projected onto the screen stays under the lod
+  // threshold, and keeps the choice in currentLod for hysteresis; so each drawn instance
+  // should have its own LodMesh.
+  struct LodMesh
+  {
+    bgfx::VertexBufferHandle vertexBuffer;
+    bgfx::IndexBufferHandle  indexBuffer;
+    float    centre[3];  // bounding sphere, in model space
+    float    radius;
+    MeshLod  lods[kMaxMeshLods];
+    uint8_t  lodCount;
+    uint8_t  currentLod;
+  };
+
   struct Camera
   {
     //
@@ -258,6 +313,136 @@ namespace GFX_NS
     Matrix projection, view;
   };
 
+  // Allocator used by gfx and its addons whenever one isn't given. Defaults to a
+  // bx::CrtAllocator; set it before anything is loaded so that everything is freed by the
+  // allocator it came from.
+  void setDefaultAllocator(bx::AllocatorI* allocator);
+
+  //
+  bx::AllocatorI* getDefaultAllocator();
+
+  // Hands out memory from large blocks, one after the other, and frees all of it at once on
+  // reset. Freeing a single allocation does nothing, unless it was the last one. Blocks come
+  // from the parent allocator, or from a fixed buffer that the allocator never grows past.
+  // Not thread safe.
+  class LinearAllocator : public bx::AllocatorI
+  {
+  public:
+
+    LinearAllocator(size_t blockSize = 64 * 1024, bx::AllocatorI* parent = nullptr);
+    LinearAllocator(void* memory, size_t size);
+    virtual ~LinearAllocator();
+
+    virtual void* realloc(void* ptr, size_t size, size_t align, const char* file, uint32_t line);
+
+    // Frees everything. A single block is kept for reuse; if there were more, they all go back
+    // to the parent and the block size grows to fit what was used.
+    void reset();
+
+    // Bytes handed out since the last reset, including alignment and headers.
+    size_t getUsed() const { return used; }
+
+    // Most bytes in use at once, since construction.
+    size_t getHighWater() const { return highWater; }
+
+  private:
+
+    struct Block
+    {
+      Block*  next;
+      size_t  size;
+    };
+
+    void* allocate(size_t size, size_t align);
+
+    bx::AllocatorI* parent;
+    Block*          blocks;     // current first
+    uint8_t*        top;
+    uint8_t*        end;
+    void*           last;       // the most recent allocation, which can be grown or freed in place
+    size_t          blockSize;
+    size_t          used;
+    size_t          highWater;
+    bool            fixed;
+  };
+
+  // Fixed size items from a free list, in blocks of itemsPerBlock taken from the parent. Larger
+  // or more aligned allocations go straight to the parent. Not thread safe.
+  class PoolAllocator : public bx::AllocatorI
+  {
+  public:
+
+    PoolAllocator(size_t itemSize, size_t itemsPerBlock = 256, bx::AllocatorI* parent = nullptr);
+    virtual ~PoolAllocator();
+
+    virtual void* realloc(void* ptr, size_t size, size_t align, const char* file, uint32_t line);
+
+    // Items handed out and not yet freed.
+    size_t getUsed() const { return used; }
+
+  private:
+
+    struct Block
+    {
+      Block*  next;
+    };
+
+    bool owns(const void* ptr) const;
+
+    bx::AllocatorI* parent;
+    Block*          blocks;
+    void*           freeList;
+    size_t          itemSize;
+    size_t          itemsPerBlock;
+    size_t          used;
+  };
+
+  // Frames that the frame arena keeps. What bgfx was given with makeRef during a frame may be
+  // read by its render thread until the next frame() returns, so each frame's memory is kept
+  // until that frame has been rendered.
+#ifndef GFX_FRAME_ARENA_COUNT
+# define GFX_FRAME_ARENA_COUNT 2
+#endif
+
+  // Scratch memory for the current frame. Each thread has its own arena, so threads can take
+  // from it in parallel without locking. It is freed all at once GFX_FRAME_ARENA_COUNT calls to
+  // frame() later, and nothing in it is ever destructed. No other thread may be using it while
+  // frame() runs.
+  bx::AllocatorI* getFrameAllocator();
+
+  //
+  void* frameAlloc(size_t size, size_t align = 16);
+
+  //
+  template<typename T>
+  inline T* frameAlloc(size_t count)
+  {
+    return (T*) frameAlloc(sizeof(T) * count, alignof(T));
+  }
+
+  struct FrameArenaStats
+  {
+    size_t   used;          // by all threads, so far this frame
+    size_t   lastFrameUsed; // by all threads, in the last frame
+    size_t   highWater;     // most used by all threads in any one frame
+    uint32_t threadCount;   // threads that have their own arena
+  };
+
+  //
+  void getFrameArenaStats(FrameArenaStats& stats);
+
+  // Size of the blocks that each thread's arenas grow by. Arenas already made keep theirs.
+  void setFrameArenaBlockSize(size_t size);
+
+  // Frees ptr with allocator in the next frame(), on the thread that calls it. Safe to call from
+  // any thread, so memory that bgfx releases on its render thread can go back to an allocator
+  // that isn't thread safe. The allocator must outlive that frame().
+  void freeOnFrame(bx::AllocatorI* allocator, void* ptr);
+
+  // A bgfx::ReleaseFn for makeRef; userData is the bx::AllocatorI that ptr came from, and the
+  // free goes through freeOnFrame.
+  void releaseOnFrame(void* ptr, void* userData);
+
   struct Context;
 
   //
@@ -274,7 +459,8 @@ namespace GFX_NS
 
   uint8_t getView();
 
-  //
+  // The height is kept in the current context for lod selection; without one, as before
+  // setContext, only bgfx's view is set.
   void setViewRect(uint8_t id, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
   //
@@ -601,9 +787,79 @@ namespace GFX_NS
 
   State getState();
 
+  // A program, its state, the textures it samples and its uniform values, packed into one
+  // block when the material is built rather than set by hand for every draw. While a material
+  // is set, draw uses it in place of the current program and state, and uploads all of its
+  // uniforms unless the last material drawn was the same one; bgfx keeps uniform values between
+  // draws, so a run of draws with one material uploads them once. Draws are submitted with the
+  // material's sortId as their depth, so bgfx groups those with the same material. The sortId
+  // takes the place of the real depth, so don't draw with materials in a view that is sorted
+  // by depth, such as one for transparent geometry.
+  static const uint32_t kMaxMaterialTextures = 8;
+  static const uint32_t kMaxMaterialUniforms = 8;
+  static const uint32_t kMaxMaterialFloats   = 64;
+
+  struct MaterialTexture
+  {
+    uint8_t             stage;
+    bgfx::UniformHandle sampler;
+    bgfx::TextureHandle texture;
+    uint32_t            flags;
+  };
+
+  struct MaterialUniform
+  {
+    bgfx::UniformHandle uniform;
+    uint16_t            num;
+    uint16_t            offset;   // into the material's block, in floats
+    uint16_t            size;     // in floats
+  };
+
+  struct Material
+  {
+    bgfx::ProgramHandle program;
+    State               state;
+    uint64_t            hash;     // of everything above and below, updated as the material is built
+    uint32_t            sortId;   // from the hash, unless it is set after the material is built
+    uint8_t             textureCount;
+    uint8_t             uniformCount;
+    uint16_t            floatCount;
+    MaterialTexture     textures[kMaxMaterialTextures];
+    MaterialUniform     uniforms[kMaxMaterialUniforms];
+    float               block[kMaxMaterialFloats];
+  };
+
+  // Starts building a material with no textures or uniforms.
+  void initMaterial(Material& material, bgfx::ProgramHandle program, State state = State::DEFAULT);
+
+  // Returns false if the material already has kMaxMaterialTextures.
+  bool addMaterialTexture(Material& material, uint8_t stage, bgfx::UniformHandle sampler, bgfx::TextureHandle texture, uint32_t flags = UINT32_MAX);
+
+  // Copies num values of type into the material's block. Returns false if it is full.
+  bool addMaterialUniform(Material& material, bgfx::UniformHandle uniform, bgfx::UniformType::Enum type, const float* value, uint16_t num = 1);
+
+  // Copies material into the context. setProgram stops using it.
+  void setMaterial(const Material& material);
+
+  // Goes back to the current program and state.
+  void clearMaterial();
+
+  // Largest screen-space error, in pixels, a LodMesh level may have before a finer one is
+  // drawn. A coarser level is only switched to once it is below (1 - hysteresis) * pixels.
+  void setLodThreshold(float pixels, float hysteresis = 0.25f);
+
+  // Level of mesh that would be drawn with the current matrices and view.
+  uint8_t selectLod(const LodMesh& mesh);
+
   //
   void draw(const Mesh& mesh);
 
+  //
+  void draw(const MeshRange& range);
+
+  //
+  void draw(LodMesh& mesh);
+
   //
   void draw(const bgfx::VertexBufferHandle& vertexBuffer);
 
@@ -611,20 +867,286 @@ namespace GFX_NS
   void draw(const bgfx::VertexBufferHandle& vertexBuffer, const bgfx::IndexBufferHandle& indexBuffer);
 
   //
+  void draw(const bgfx::VertexBufferHandle& vertexBuffer, const bgfx::IndexBufferHandle& indexBuffer, uint32_t firstIndex, uint32_t indexCount);
+
+  // Submits the frame with bgfx::frame, then does the frees queued by freeOnFrame, resets the
+  // oldest of the frame arenas and destroys the pooled resources that were waiting for it.
   void frame();
 
+  // Calls to frame() so far. Something last used in a submit while it was n can be reused once
+  // it reaches n + GFX_FRAME_ARENA_COUNT.
+  uint32_t getFrameCount();
+
+
+  // A push/pop stack for the Context, with its memory from an allocator.
+  template<typename T>
+  class Stack
+  {
+  public:
+
+    Stack()
+      : allocator(nullptr),
+        items(nullptr),
+        count(0),
+        capacity(0)
+    {
+    }
+
+    ~Stack()
+    {
+      if (items != nullptr)
+      {
+        for(uint32_t i=0;i < count;i++)
+          items[i].~T();
+        BX_FREE(allocator, items);
+      }
+    }
+
+    void setAllocator(bx::AllocatorI* _allocator)
+    {
+      allocator = _allocator;
+    }
+
+    void push_back(const T& item)
+    {
+      if (count == capacity)
+      {
+        uint32_t newCapacity = capacity > 0 ? capacity * 2 : 16;
+        T* newItems = (T*) BX_ALLOC(allocator, sizeof(T) * newCapacity);
+        for(uint32_t i=0;i < count;i++)
+        {
+          new (&newItems[i]) T(items[i]);
+          items[i].~T();
+        }
+        if (items != nullptr)
+          BX_FREE(allocator, items);
+        items = newItems;
+        capacity = newCapacity;
+      }
+
+      new (&items[count++]) T(item);
+    }
+
+    void pop_back()
+    {
+      items[--count].~T();
+    }
+
+    T& back()
+    {
+      return items[count - 1];
+    }
+
+    const T& back() const
+    {
+      return items[count - 1];
+    }
+
+    bool empty() const
+    {
+      return count == 0;
+    }
+
+    uint32_t size() const
+    {
+      return count;
+    }
+
+  private:
+
+    Stack(const Stack&);
+    Stack& operator=(const Stack&);
+
+    bx::AllocatorI* allocator;
+    T*              items;
+    uint32_t        count;
+    uint32_t        capacity;
+  };
+
+  // Dense storage for values that are referred to by Id, a struct holding a uint32_t value.
+  // The low 16 bits of an id are its slot and the high 16 bits the slot's generation when it
+  // was made; destroying a value bumps its slot's generation, so an id kept after it was
+  // destroyed finds nothing rather than whatever reused the slot. Values are kept packed
+  // together, in no particular order, for looping over with data() and size().
+  template<typename T, typename Id>
+  class HandlePool
+  {
+  public:
+
+    // ids are never 0; 0 is returned once every slot is in use.
+    Id create(const T& value)
+    {
+      uint16_t slot;
+      if (freeSlots.empty() == false)
+      {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+      }
+      else if (slots.size() == UINT16_MAX)
+      {
+        Id invalid = { 0 };
+        return invalid;
+      }
+      else
+      {
+        Slot unused = { 0, 1 };
+        slot = uint16_t(slots.size());
+        slots.push_back(unused);
+      }
+
+      slots[slot].dense = uint16_t(values.size());
+      values.push_back(value);
+      denseSlots.push_back(slot);
+
+      Id id;
+      id.value = (uint32_t(slots[slot].generation) << 16) | slot;
+      return id;
+    }
+
+    // nullptr if id was destroyed.
+    T* get(Id id)
+    {
+      uint16_t slot = uint16_t(id.value & 0xffff);
+      if (slot >= slots.size() || slots[slot].generation != (id.value >> 16) || id.value == 0)
+        return nullptr;
+
+      return &values[slots[slot].dense];
+    }
+
+    // False if id was already destroyed; value is what it held.
+    bool destroy(Id id, T& value)
+    {
+      T* item = get(id);
+      if (item == nullptr)
+        return false;
+
+      value = *item;
+
+      // the last value moves into the hole.
+      uint16_t slot = uint16_t(id.value & 0xffff);
+      uint16_t dense = slots[slot].dense;
+      values[dense] = values.back();
+      denseSlots[dense] = denseSlots.back();
+      slots[denseSlots[dense]].dense = dense;
+      values.pop_back();
+      denseSlots.pop_back();
+
+      // generation 0 is never handed out, so no id is 0.
+      if (++slots[slot].generation == 0)
+        slots[slot].generation = 1;
+      freeSlots.push_back(slot);
+      return true;
+    }
+
+    //
+    T* data()
+    {
+      return values.empty() ? nullptr : &values[0];
+    }
+
+    //
+    uint32_t size() const
+    {
+      return uint32_t(values.size());
+    }
+
+  private:
+
+    struct Slot
+    {
+      uint16_t dense;
+      uint16_t generation;
+    };
+
+    GFX_VECTOR<T>        values;
+    GFX_VECTOR<uint16_t> denseSlots;   // the slot of each value
+    GFX_VECTOR<Slot>     slots;
+    GFX_VECTOR<uint16_t> freeSlots;
+  };
+
+  // Meshes, programs and materials held in HandlePools and drawn by id, so an id whose resource
+  // has been destroyed draws nothing. Destroying one invalidates its id straight away, but its
+  // bgfx resources are only destroyed GFX_FRAME_ARENA_COUNT calls to frame() later, once the
+  // frames that may have drawn with them have been rendered.
+  struct MeshId     { uint32_t value; };
+  struct ProgramId  { uint32_t value; };
+  struct MaterialId { uint32_t value; };
+
+  // The pool owns mesh's buffers from now on.
+  MeshId addMesh(const Mesh& mesh);
+
+  // The pool owns range's buffers if owned is true; otherwise, as for a range of a GeometryArena,
+  // they are left to whatever made them.
+  MeshId addMesh(const MeshRange& range, bool owned);
+
+  // nullptr if id was destroyed.
+  const MeshRange* getMesh(MeshId id);
+
+  //
+  void destroyMesh(MeshId id);
+
+  // How a pooled program is let go of; bgfx::destroyProgram, or releaseProgram for those that
+  // came from loadProgram.
+  typedef void (*ReleaseProgramFn)(bgfx::ProgramHandle program);
+
+  // The pool owns program from now on, and lets it go with release, or bgfx::destroyProgram if
+  // it is nullptr.
+  ProgramId addProgram(bgfx::ProgramHandle program, ReleaseProgramFn release = nullptr);
+
+  // An invalid handle if id was destroyed.
+  bgfx::ProgramHandle getProgram(ProgramId id);
+
+  //
+  void destroyProgram(ProgramId id);
+
+  // Materials hold no bgfx resources of their own, so they go straight away.
+  MaterialId addMaterial(const Material& material);
+
+  // nullptr if id was destroyed.
+  const Material* getMaterial(MaterialId id);
+
+  //
+  void destroyMaterial(MaterialId id);
+
+  // Nothing is drawn if the id was destroyed.
+  void draw(MeshId id);
+
+  // An id that was destroyed sets an invalid program, so nothing is drawn with it.
+  void setProgram(ProgramId id);
+
+  // An id that was destroyed clears the material.
+  void setMaterial(MaterialId id);
+
+  struct HandlePoolStats
+  {
+    uint32_t meshes;
+    uint32_t programs;
+    uint32_t materials;
+    uint32_t pendingDestroys;   // waiting for their frames to be rendered
+  };
+
+  //
+  void getHandlePoolStats(HandlePoolStats& stats);
 
   struct Context
   {
-    Context();
+    // allocator is used for the Context's stacks, nullptr for getDefaultAllocator().
+    Context(bx::AllocatorI* allocator = nullptr);
     ~Context();
 
 
       bgfx::ProgramHandle  currentProgram;
+
+      Material             material;
+      uint64_t             boundMaterialHash;   // of the material whose uniforms were last uploaded
+      bool                 hasMaterial;
+      bool                 hasBoundMaterial;
       
-      GFX_VECTOR<Matrix>   model, view, projection;
-      GFX_VECTOR<State>    state;
-      GFX_VECTOR<uint8_t>  views;
+      bx::AllocatorI*      allocator;
+
+      Stack<Matrix>        model, view, projection;
+      Stack<State>         state;
+      Stack<uint8_t>       views;
 
       uint32_t modelVersion, viewVersion, projectionVersion;
       uint32_t lastModelVersion, lastViewVersion, lastProjectionVersion;
@@ -634,6 +1156,9 @@ namespace GFX_NS
       uint32_t viewsVersion;
       uint32_t lastViewsVersion;
 
+      uint16_t viewHeights[UINT8_MAX + 1];
+      float    lodThreshold, lodHysteresis;
+
   };
 
 }
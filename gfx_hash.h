@@ -0,0 +1,122 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __GFX_HASH_H__
+#define __GFX_HASH_H__
+
+#include "gfx.h"
+
+#include <string.h>
+
+// Hashing and the handle cache that gfx and its addons share; not part of the API.
+
+namespace GFX_NS
+{
+
+  // FNV-1a, 64 bit; hashes are chained by passing the last one in, starting from kHashSeed.
+  static const uint64_t kHashSeed = 14695981039346656037ull;
+
+  inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+  {
+    const uint8_t* bytes = (const uint8_t*) data;
+    for(size_t i=0;i < size;i++)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+
+    return hash;
+  }
+
+  // Including the terminator, so that "ab" + "c" and "a" + "bc" differ.
+  inline uint64_t hashString(uint64_t hash, const char* str)
+  {
+    return hashBytes(hash, str, strlen(str) + 1);
+  }
+
+  static const uint16_t kNoCacheEntry = UINT16_MAX;
+
+  // Entries are indexed by their bgfx handle's idx and chained from a bucket by the hash of their
+  // key, which is all that is compared; at 64 bits, keys won't collide. Entry is a plain struct
+  // with at least a uint64_t hash, a uint16_t next (in its bucket) and a bool cached.
+  template<typename Entry, uint32_t BucketCount = 256>
+  struct HashCache
+  {
+    HashCache()
+    {
+      memset(buckets, 0xff, sizeof(buckets));
+    }
+
+    uint16_t find(uint64_t hash) const
+    {
+      for(uint16_t idx = buckets[hash % BucketCount];idx != kNoCacheEntry;idx = entries[idx].next)
+      {
+        if (entries[idx].hash == hash)
+          return idx;
+      }
+      return kNoCacheEntry;
+    }
+
+    // The entry's other members are zeroed.
+    Entry& insert(uint16_t idx, uint64_t hash)
+    {
+      if (entries.size() <= idx)
+      {
+        Entry unused;
+        memset(&unused, 0, sizeof(unused));
+        entries.resize(idx + 1, unused);
+      }
+
+      uint16_t& bucket = buckets[hash % BucketCount];
+
+      Entry& entry = entries[idx];
+      memset(&entry, 0, sizeof(entry));
+      entry.hash = hash;
+      entry.next = bucket;
+      entry.cached = true;
+      bucket = idx;
+      return entry;
+    }
+
+    void remove(uint16_t idx)
+    {
+      uint16_t* link = &buckets[entries[idx].hash % BucketCount];
+      while (*link != idx)
+        link = &entries[*link].next;
+
+      *link = entries[idx].next;
+      entries[idx].cached = false;
+    }
+
+    // nullptr if idx isn't in the cache.
+    Entry* get(uint16_t idx)
+    {
+      return idx < entries.size() && entries[idx].cached ? &entries[idx] : nullptr;
+    }
+
+    GFX_VECTOR<Entry> entries;
+    uint16_t          buckets[BucketCount];
+  };
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+// gfx
+// 
+// Copyright (c) 2016 Robin Southern -- github.com/betajaen/gfx
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// gfx_pack; builds and lists gfx archives (addons/gfx_archive.h).
+//
+//  gfx_pack <archive> <file>...   packs the files, named by their paths as given
+//  gfx_pack -l <archive>          lists an archive's entries
+//
+// Run it from the directory the application loads from, so that entries are named as the
+// loaders will ask for them, e.g. with getShaderPath's directories, where OpenGL's are under
+// shader/ rather than shaders/:
+//
+//  gfx_pack assets.gfxa shaders/dx9/*.bin shaders/dx11/*.bin shader/glsl/*.bin meshes/*.txt
+
+#include "gfx_archive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char* argv[])
+{
+  if (argc >= 3 && strcmp(argv[1], "-l") == 0)
+  {
+    gfx::Archive archive;
+    if (archive.open(argv[2]) == false)
+    {
+      fprintf(stderr, "gfx_pack: %s is not an archive\n", argv[2]);
+      return 1;
+    }
+
+    for(uint32_t i=0;i < archive.getEntryCount();i++)
+      printf("%10u %s\n", uint32_t(archive.getEntrySize(i)), archive.getEntryName(i));
+
+    return 0;
+  }
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: gfx_pack <archive> <file>...\n       gfx_pack -l <archive>\n");
+    return 1;
+  }
+
+  gfx::ArchiveBuilder builder;
+
+  for(int i=2;i < argc;i++)
+  {
+    if (builder.addFile(argv[i]) == false)
+    {
+      fprintf(stderr, "gfx_pack: can't add %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (builder.save(argv[1]) == false)
+  {
+    fprintf(stderr, "gfx_pack: can't write %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%u files packed into %s\n", uint32_t(builder.getEntryCount()), argv[1]);
+  return 0;
+}